@@ -25,6 +25,12 @@ static bool _glfw_surface_create(
 
   return true;
 }
+
+static void _glfw_framebuffer_resize(GLFWwindow* win, int w, int h) {
+  struct cr_context_t* ctx = (struct cr_context_t*)glfwGetWindowUserPointer(win);
+  cr_output_resize(ctx, 0, (uint32_t)w, (uint32_t)h);
+}
+
 int main() {
   GLFWwindow* window;
 
@@ -63,6 +69,9 @@ int main() {
   };
   cr_context_create(&ctx, &info);
 
+  glfwSetWindowUserPointer(window, &ctx);
+  glfwSetFramebufferSizeCallback(window, _glfw_framebuffer_resize);
+
   /* Loop until the user closes the window */
   while (!glfwWindowShouldClose(window)) {
     cr_draw_frame(&ctx);
@@ -0,0 +1,34 @@
+#include <corender/capture.h>
+#include <stdio.h>
+#include <string.h>
+
+// Replays a capture written with `cr_context_init_info_t.capture_path` on a
+// headless context and prints frame time statistics, so CPU-side renderer
+// changes (culling, upload and frame loop overhead) can be compared on the
+// exact same sequence of API calls. Captured draws are not issued.
+
+int main(int argc, char** argv) {
+  struct cr_replay_options_t opts = {0};
+  const char* path = NULL;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--validation") == 0) opts.enable_validation = true;
+    else if(strcmp(argv[i], "--verbose") == 0) opts.log_verbose = true;
+    else path = argv[i];
+  }
+  if(!path) {
+    fprintf(stderr, "usage: %s [--validation] [--verbose] <capture>\n", argv[0]);
+    return 1;
+  }
+
+  struct cr_replay_stats_t stats;
+  if(!cr_replay_run(path, &opts, &stats)) {
+    fprintf(stderr, "replay of '%s' failed\n", path);
+    return 1;
+  }
+
+  printf("frames:   %u (%.2f ms total)\n", stats.n_frames, stats.total_ms);
+  printf("replay:   avg %.3f ms, p50 %.3f ms, p99 %.3f ms, min %.3f ms, max %.3f ms\n",
+         stats.avg_ms, stats.p50_ms, stats.p99_ms, stats.min_ms, stats.max_ms);
+  printf("captured: avg %.3f ms, p99 %.3f ms\n", stats.captured_avg_ms, stats.captured_p99_ms);
+  return 0;
+}
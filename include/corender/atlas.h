@@ -0,0 +1,111 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+#define CR_ATLAS_MAX_PAGES 8
+// Border left around every entry, so linear filtering never picks up a
+// neighbour.
+#define CR_ATLAS_PADDING 1
+
+struct cr_atlas_info_t {
+  // VK_FORMAT_R8_UNORM (e.g. glyph coverage) or a 4 byte RGBA/BGRA format.
+  VkFormat fmt;
+  // Width and height of a page, 1024 when zero.
+  uint32_t page_size;
+  // Pages added before cold ones are evicted, at most CR_ATLAS_MAX_PAGES
+  // (the default when zero).
+  uint32_t max_pages;
+};
+
+struct cr_atlas_entry_t {
+  uint32_t page;
+  VkRect2D rect;
+  // Normalized u0, v0, u1, v1 of `rect` within the page.
+  float uv[4];
+};
+
+// One segment of a page's skyline: the lowest free row over [x, x + w).
+struct cr_atlas_skyline_t {
+  uint32_t x, y, w;
+};
+
+struct cr_atlas_page_t {
+  VkImage image;
+  VkImageView view;
+  VkDeviceMemory mem;
+  VkDeviceSize mem_size;
+  uint32_t mem_type;
+  // Left undefined until the first upload, shader-read-only afterwards.
+  bool initialized;
+
+  struct cr_atlas_skyline_t* skyline;
+  uint32_t n_skyline;
+
+  // Host copy of the page; inserts write into it and only the rects
+  // inserted since the last frame are uploaded from it.
+  uint8_t* shadow;
+  VkRect2D* dirty;
+  uint32_t n_dirty, dirty_cap;
+
+  uint32_t n_entries;
+  // Newest frame that used an entry on the page.
+  uint64_t last_use_no;
+};
+
+struct cr_atlas_slot_t;
+
+struct cr_atlas_t {
+  VkFormat fmt;
+  uint32_t bpp;
+  uint32_t page_size, max_pages;
+
+  struct cr_atlas_page_t pages[CR_ATLAS_MAX_PAGES];
+  uint32_t n_pages;
+
+  // Entries by key, in an open-addressed table of slot indices.
+  struct cr_atlas_slot_t* slots;
+  uint32_t n_slots, n_live, slot_cap, free_slot;
+  uint32_t* table;
+  uint32_t table_cap;
+
+  uint64_t n_evictions;
+  uint64_t n_uploaded_bytes;
+
+  // Atlases of the context, uploaded by cr_draw_frame.
+  struct cr_atlas_t* next;
+};
+
+bool cr_atlas_init(struct cr_context_t* ctx, struct cr_atlas_t* o_atlas, const struct cr_atlas_info_t* info);
+
+// Looks an entry up by its (non-zero) key and marks it as used by the
+// frame being built. Fails for unknown and evicted keys.
+bool cr_atlas_lookup(
+  struct cr_context_t* ctx,
+  struct cr_atlas_t* atlas,
+  uint64_t key,
+  struct cr_atlas_entry_t* o_entry);
+
+// Packs a `width` x `height` image into the atlas; a key already present
+// returns its entry unchanged. When every page is full, a page is added
+// or, at max_pages, the least recently used page not sampled by the frame
+// being built is evicted with all its entries. The pixels are uploaded at
+// the start of the next cr_draw_frame.
+bool cr_atlas_insert(
+  struct cr_context_t* ctx,
+  struct cr_atlas_t* atlas,
+  uint64_t key,
+  uint32_t width,
+  uint32_t height,
+  const void* pixels,
+  uint32_t stride,
+  struct cr_atlas_entry_t* o_entry);
+
+// Records the rects inserted into any atlas of the context since the last
+// frame. Called by cr_draw_frame before any output is recorded.
+bool cr_atlas_record_uploads(struct cr_context_t* ctx, VkCommandBuffer cmd);
+
+// Retires the pages through the deletion queue.
+void cr_atlas_destroy(struct cr_context_t* ctx, struct cr_atlas_t* atlas);
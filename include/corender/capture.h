@@ -0,0 +1,106 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+// Binary capture stream: a header followed by records, each an 8-byte
+// aligned `cr_capture_record_t` followed by `size` bytes of payload.
+#define CR_CAPTURE_MAGIC   "CRCAPTUR"
+#define CR_CAPTURE_VERSION 2
+
+enum cr_capture_record_type_t {
+  CR_CAPTURE_RECORD_INIT = 1,
+  CR_CAPTURE_RECORD_FRAME,
+  CR_CAPTURE_RECORD_UPLOAD,
+  CR_CAPTURE_RECORD_DRAW_LIST_CREATE,
+  CR_CAPTURE_RECORD_DRAW_LIST_DESTROY,
+  CR_CAPTURE_RECORD_DRAW_OBJECT_ADD,
+  CR_CAPTURE_RECORD_DRAW_OBJECT_UPDATE,
+  CR_CAPTURE_RECORD_DRAW_OBJECT_REMOVE,
+  CR_CAPTURE_RECORD_READBACK_REQUEST,
+};
+
+struct cr_capture_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct cr_capture_record_t {
+  uint32_t type;
+  uint32_t size;
+};
+
+struct cr_capture_init_t {
+  uint32_t width, height;
+  uint32_t enable_validation;
+  uint32_t reserved;
+};
+
+struct cr_capture_frame_t {
+  // CPU time between the previous and this frame in the captured process.
+  uint64_t frame_ns;
+  // Draw list attached to the primary output, 0 when none.
+  uint32_t draw_list;
+  uint32_t reserved;
+};
+
+struct cr_capture_draw_list_t {
+  uint32_t draw_list;
+  uint32_t capacity;
+};
+
+// Followed by a `struct cr_draw_object_t` for adds and updates.
+struct cr_capture_draw_object_t {
+  uint32_t draw_list;
+  uint32_t id;
+};
+
+struct cr_capture_t {
+  int fd;
+  uint8_t* map;
+  size_t map_size;
+  size_t offset;
+
+  uint32_t next_draw_list;
+  uint64_t last_frame_ns;
+  bool failed;
+};
+
+bool cr_capture_open(struct cr_capture_t* o_cap, const char* path);
+void cr_capture_close(struct cr_capture_t* cap);
+
+// Reserves a record in the mapped stream and returns its payload, so
+// callers serialize straight into the file. NULL if capture is off or failed.
+void* cr_capture_record(struct cr_capture_t* cap, enum cr_capture_record_type_t type, uint32_t size);
+
+// Records the frame boundary and the frame's upload memory.
+// Called by cr_draw_frame before submission.
+void cr_capture_frame(struct cr_context_t* ctx);
+
+struct cr_replay_stats_t {
+  uint32_t n_frames;
+  double total_ms;
+  double min_ms, max_ms, avg_ms, p50_ms, p99_ms;
+  // Same statistics for the frame times recorded in the capture.
+  double captured_avg_ms, captured_p99_ms;
+};
+
+struct cr_replay_options_t {
+  bool enable_validation;
+  bool log_verbose;
+  // Stops after this many frames when non-zero.
+  uint32_t max_frames;
+  // Optional per-frame replay time in milliseconds. Must hold `max_frames`
+  // entries, so it requires `max_frames`; the first `n_frames` are written.
+  double* o_frame_ms;
+};
+
+// Plays a capture back on a headless context as fast as possible. This is a
+// CPU-side benchmark: draw object changes, readback requests and upload
+// copies are replayed, but captured draw lists have no pipeline or index
+// buffer, so each frame measures culling, indirect buffer writes and an
+// empty render pass rather than the captured GPU workload.
+bool cr_replay_run(const char* path, const struct cr_replay_options_t* opts, struct cr_replay_stats_t* o_stats);
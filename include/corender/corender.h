@@ -1,4 +1,14 @@
 #pragma once 
+#include "atlas.h"
+#include "deletion.h"
+#include "dispatch.h"
+#include "graph.h"
+#include "host.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "readback.h"
+#include "shm.h"
+#include "texture.h"
 #include <vulkan/vulkan_core.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -9,14 +19,27 @@ struct cr_surface_t {
 };
 
 #define CR_FRAME_COUNT 2
+#define CR_FRAME_UPLOAD_SIZE (4u << 20)
 
 struct cr_frame_t {
   VkCommandPool cmd_pool;
   VkCommandBuffer cmd_buf;
 
-  VkSemaphore image_available;
-  VkSemaphore* render_finished_per_image;
   VkFence in_flight_fence;
+
+  // Linear, persistently mapped upload memory, reset once the frame's
+  // fence has signaled. Created on the frame's first upload.
+  struct cr_buffer_t upload;
+  VkDeviceSize upload_offset;
+
+  // Reset together with the upload memory.
+  struct cr_arena_t scratch;
+
+  // Set once the fence was waited on for the frame currently being built.
+  bool begun;
+
+  // Number of the last submission signaling in_flight_fence.
+  uint64_t submitted_no;
 };
 
 struct cr_swapchain_t {
@@ -27,26 +50,77 @@ struct cr_swapchain_t {
   VkFormat fmt;
   VkSurfaceFormatKHR surf_fmt;
   VkPresentModeKHR present_mode;
+  VkImageUsageFlags usage;
 
   uint32_t n_imgs;
+  // Length of the arrays below; they come from the context arena and are
+  // reused when the swapchain is recreated with no more images.
+  uint32_t img_capacity;
   VkImage* imgs;
   VkImageView* img_views;
- 
+
+  // Only set for headless contexts, whose images are plain offscreen
+  // images owned by corender.
+  VkDeviceMemory* img_mems;
+  VkDeviceSize img_mem_size;
+  uint32_t img_mem_type;
+
+  // Layout the images are left in at the end of a frame.
+  VkImageLayout final_layout;
 };
 
-struct cr_frameloop_t {
+#define CR_MAX_OUTPUTS 8
+
+// A surface with its own swapchain, presented together with all other
+// outputs of the context.
+struct cr_output_t {
+  struct cr_surface_t surf;
   struct cr_swapchain_t swapchain;
 
+  // The context render pass when the output shares the primary output's
+  // format, so pipelines built against it work on every such output.
+  VkRenderPass pass;
+  bool owns_pass;
+
+  // Per swapchain image, `img_capacity` long.
+  uint32_t img_capacity;
   VkFramebuffer* fbs;
-  uint32_t n_fbs;
+  VkFence* image_fences;
+
+  // Signaled by the acquire of each frame in flight.
+  VkSemaphore image_available[CR_FRAME_COUNT];
+  // Signaled by the submission rendering into each swapchain image.
+  VkSemaphore* render_finished_per_image;
 
+  // Optional; culled and drawn indirectly inside the output's render pass.
+  struct cr_draw_list_t* draw_list;
+  // Optional; drawn after the draw list, under the same rules.
+  struct cr_text_t* text;
+
+  // Optional; replaces the output's built-in render pass. `graph_target` is
+  // an image imported with the swapchain's format, extent and final layout,
+  // bound to the acquired image each frame.
+  struct cr_graph_t* graph;
+  uint32_t graph_target;
+
+  // Image of the frame being built, valid when `acquired` is set.
+  uint32_t image_idx;
+  bool acquired;
+
+  // Set when the swapchain no longer matches the surface; it is recreated
+  // before the next acquire. Graphs attached to the output must be rebuilt
+  // when `swapchain.dimensions` change.
+  bool stale;
+};
+
+struct cr_frameloop_t {
   VkRenderPass crnt_pass;
   
   struct cr_frame_t frames[CR_FRAME_COUNT];
   uint32_t frame_idx;
 
-  VkFence* swapchain_image_fences;
-
+  // Submissions so far, and the newest one known to have finished on the GPU.
+  uint64_t frame_no, completed_no;
 };
 
 typedef bool (*cr_surface_create_func_t)(
@@ -55,6 +129,15 @@ typedef bool (*cr_surface_create_func_t)(
     void* userdata
     );
 
+// Runs on an init worker thread while the swapchain is set up, once the
+// pipeline cache is loaded. Must only create shader modules and pipelines.
+typedef bool (*cr_pipelines_create_func_t)(
+    struct cr_context_t* ctx,
+    VkPipelineCache cache,
+    VkRenderPass pass,
+    void* userdata
+    );
+
 struct cr_context_init_info_t {
   const char** exts;
   size_t n_exts;
@@ -68,6 +151,35 @@ struct cr_context_init_info_t {
   cr_surface_create_func_t surface_create;
 
   bool log_to_file, log_verbose,  log_quiet;
+
+  // Serializes API calls into a replayable capture stream when set.
+  const char* capture_path;
+
+  struct cr_memory_pressure_info_t memory_pressure;
+  struct cr_host_info_t host;
+
+  void* pipelines_userdata;
+  cr_pipelines_create_func_t pipelines_create;
+  // Defaults to $XDG_CACHE_HOME/corender/pipeline.cache when NULL. The
+  // cache is only loaded and saved when this or `pipelines_create` is set.
+  const char* pipeline_cache_path;
+
+  // Entry point all Vulkan functions are resolved through, e.g.
+  // glfwGetInstanceProcAddress. Defaults to the one exported by
+  // libvulkan.so.1, opened at runtime.
+  PFN_vkGetInstanceProcAddr get_instance_proc_addr;
+};
+
+struct cr_device_features_t {
+  bool draw_indirect_count;
+  bool multi_draw_indirect;
+  // Required by draw lists, see cr_draw_object_t.
+  bool draw_indirect_first_instance;
+  bool memory_budget;
+  bool external_memory_host;
+  // minImportedHostPointerAlignment, valid with external_memory_host.
+  VkDeviceSize host_pointer_alignment;
+  bool texture_compression_bc;
 };
 
 struct cr_log_state_t {
@@ -76,6 +188,12 @@ struct cr_log_state_t {
 };
 
 struct cr_context_t {
+  struct cr_host_t host;
+
+  // Vulkan entry points; callers creating pipelines in
+  // `pipelines_create` should call through it as well.
+  struct cr_dispatch_t vk;
+
   VkInstance instance;
   VkPhysicalDevice phys_dev;
   VkDevice logical_dev;
@@ -83,13 +201,49 @@ struct cr_context_t {
   VkQueue graphics_queue, present_queue;
   VkCommandPool cmd_pool;
 
-  struct cr_surface_t surf;
-  struct cr_swapchain_t swapchain;
+  VkPhysicalDeviceMemoryProperties mem_props;
+  struct cr_device_features_t features;
+  struct cr_memory_t memory;
+  struct cr_pipeline_cache_t pipeline_cache;
+
+  // outputs[0] is the primary output created from the init info; it is
+  // the one read back and captured.
+  struct cr_output_t outputs[CR_MAX_OUTPUTS];
+  uint32_t n_outputs;
   struct cr_frameloop_t frameloop;
+  struct cr_deletion_queue_t deletion;
+
+  struct cr_readback_t readback;
+  struct cr_texture_uploads_t textures;
+  struct cr_atlas_t* atlases;
+
+  struct cr_capture_t* capture;
 
   struct cr_log_state_t log;
 };
 
 bool cr_context_create(struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
+// Waits for the device to go idle and destroys everything the context
+// created, including retired objects. Draw lists, graphs, textures and
+// atlases are owned by the caller and must be destroyed before.
 bool cr_context_destroy(struct cr_context_t* ctx);
 bool cr_draw_frame(struct cr_context_t* ctx);
+
+// Adds an output presenting on another surface, sharing the device,
+// memory and pipelines of the context. Every output is recorded into the
+// same submission and presented with a single vkQueuePresentKHR.
+bool cr_output_add(
+  struct cr_context_t* ctx,
+  cr_surface_create_func_t surface_create,
+  void* userdata,
+  uint32_t* o_idx);
+
+// Recreates the output's swapchain at the given size before the next frame,
+// e.g. from a window's framebuffer resize callback. Old swapchain objects
+// are retired through the deletion queue.
+bool cr_output_resize(struct cr_context_t* ctx, uint32_t idx, uint32_t width, uint32_t height);
+
+// Waits until the GPU has released the frame about to be built and resets
+// its per-frame state. Called implicitly by cr_draw_frame and by the first
+// upload of a frame, so callers rarely need it.
+bool cr_frame_begin(struct cr_context_t* ctx);
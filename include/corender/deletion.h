@@ -0,0 +1,84 @@
+#pragma once
+#include "memory.h"
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+enum cr_deletion_type_t {
+  CR_DELETION_BUFFER = 0,
+  CR_DELETION_MEMORY,
+  CR_DELETION_BUFFER_VIEW,
+  CR_DELETION_IMAGE,
+  CR_DELETION_IMAGE_VIEW,
+  CR_DELETION_FRAMEBUFFER,
+  CR_DELETION_RENDER_PASS,
+  CR_DELETION_SEMAPHORE,
+  CR_DELETION_FENCE,
+  CR_DELETION_SWAPCHAIN,
+  CR_DELETION_PIPELINE,
+  CR_DELETION_PIPELINE_LAYOUT,
+  CR_DELETION_SHADER_MODULE,
+  CR_DELETION_SAMPLER,
+  CR_DELETION_DESCRIPTOR_POOL,
+  CR_DELETION_DESCRIPTOR_SET_LAYOUT,
+  CR_DELETION_COMMAND_POOL,
+};
+
+union cr_deletion_handle_t {
+  struct cr_buffer_t buffer;
+  struct {
+    VkDeviceMemory handle;
+    VkDeviceSize size;
+    uint32_t type;
+  } memory;
+  VkBufferView buffer_view;
+  VkImage image;
+  VkImageView image_view;
+  VkFramebuffer framebuffer;
+  VkRenderPass render_pass;
+  VkSemaphore semaphore;
+  VkFence fence;
+  VkSwapchainKHR swapchain;
+  VkPipeline pipeline;
+  VkPipelineLayout pipeline_layout;
+  VkShaderModule shader_module;
+  VkSampler sampler;
+  VkDescriptorPool descriptor_pool;
+  VkDescriptorSetLayout descriptor_set_layout;
+  VkCommandPool command_pool;
+};
+
+struct cr_deletion_t {
+  enum cr_deletion_type_t type;
+  union cr_deletion_handle_t handle;
+  // Destroyed once the frameloop's completed_no reaches this submission.
+  uint64_t retire_no;
+};
+
+// FIFO of retired objects. Entries are pushed with non-decreasing
+// retire_no, so flushing only ever pops from the head.
+struct cr_deletion_queue_t {
+  struct cr_deletion_t* entries;
+  uint32_t head, n, cap;
+
+  uint64_t n_destroyed;
+};
+
+// Retires an object that may still be referenced by the frame being built
+// or by any frame in flight. It is destroyed by the first cr_frame_begin
+// that observes the current frame as completed, without waiting for the
+// device to go idle.
+bool cr_deletion_push(struct cr_context_t* ctx, enum cr_deletion_type_t type, union cr_deletion_handle_t handle);
+
+// Retires the buffer with its memory and clears `buf`.
+bool cr_deletion_push_buffer(struct cr_context_t* ctx, struct cr_buffer_t* buf);
+
+// Destroys every entry retired at or before `completed_no`. Called by
+// cr_frame_begin; pass UINT64_MAX once the device is idle to drain the
+// queue.
+void cr_deletion_flush(struct cr_context_t* ctx, uint64_t completed_no);
+
+// Drains the queue and frees its storage. The device must be idle.
+void cr_deletion_destroy(struct cr_context_t* ctx);
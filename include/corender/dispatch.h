@@ -0,0 +1,142 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+
+struct cr_context_t;
+
+// Vulkan entry points used by corender, named without the `vk` prefix.
+// The library is built with VK_NO_PROTOTYPES and never links the loader:
+// every call goes through `ctx->vk`. Device-level functions come from
+// vkGetDeviceProcAddr and so skip the loader's dispatch trampolines.
+
+#define CR_VK_GLOBAL_FUNCS(X) \
+  X(CreateInstance)
+
+#define CR_VK_INSTANCE_FUNCS(X) \
+  X(DestroyInstance) \
+  X(EnumeratePhysicalDevices) \
+  X(EnumerateDeviceExtensionProperties) \
+  X(GetPhysicalDeviceQueueFamilyProperties) \
+  X(GetPhysicalDeviceProperties) \
+  X(GetPhysicalDeviceProperties2) \
+  X(GetPhysicalDeviceMemoryProperties) \
+  X(GetPhysicalDeviceMemoryProperties2) \
+  X(GetPhysicalDeviceFeatures2) \
+  X(GetPhysicalDeviceFormatProperties) \
+  X(CreateDevice) \
+  X(GetDeviceProcAddr)
+
+// VK_KHR_surface, only enabled by callers that present.
+#define CR_VK_INSTANCE_OPTIONAL_FUNCS(X) \
+  X(DestroySurfaceKHR) \
+  X(GetPhysicalDeviceSurfaceSupportKHR) \
+  X(GetPhysicalDeviceSurfaceCapabilitiesKHR) \
+  X(GetPhysicalDeviceSurfaceFormatsKHR) \
+  X(GetPhysicalDeviceSurfacePresentModesKHR)
+
+#define CR_VK_DEVICE_FUNCS(X) \
+  X(DestroyDevice) \
+  X(DeviceWaitIdle) \
+  X(GetDeviceQueue) \
+  X(QueueSubmit) \
+  X(AllocateMemory) \
+  X(FreeMemory) \
+  X(MapMemory) \
+  X(UnmapMemory) \
+  X(InvalidateMappedMemoryRanges) \
+  X(CreateBuffer) \
+  X(DestroyBuffer) \
+  X(CreateBufferView) \
+  X(DestroyBufferView) \
+  X(GetBufferMemoryRequirements) \
+  X(BindBufferMemory) \
+  X(CreateImage) \
+  X(DestroyImage) \
+  X(CreateImageView) \
+  X(DestroyImageView) \
+  X(GetImageMemoryRequirements) \
+  X(BindImageMemory) \
+  X(CreateSampler) \
+  X(DestroySampler) \
+  X(CreateFence) \
+  X(DestroyFence) \
+  X(ResetFences) \
+  X(GetFenceStatus) \
+  X(WaitForFences) \
+  X(CreateSemaphore) \
+  X(DestroySemaphore) \
+  X(CreateRenderPass) \
+  X(DestroyRenderPass) \
+  X(CreateFramebuffer) \
+  X(DestroyFramebuffer) \
+  X(CreateShaderModule) \
+  X(DestroyShaderModule) \
+  X(CreatePipelineCache) \
+  X(DestroyPipelineCache) \
+  X(GetPipelineCacheData) \
+  X(CreateGraphicsPipelines) \
+  X(DestroyPipeline) \
+  X(CreatePipelineLayout) \
+  X(DestroyPipelineLayout) \
+  X(CreateDescriptorSetLayout) \
+  X(DestroyDescriptorSetLayout) \
+  X(CreateDescriptorPool) \
+  X(DestroyDescriptorPool) \
+  X(AllocateDescriptorSets) \
+  X(UpdateDescriptorSets) \
+  X(CreateCommandPool) \
+  X(DestroyCommandPool) \
+  X(ResetCommandPool) \
+  X(AllocateCommandBuffers) \
+  X(BeginCommandBuffer) \
+  X(EndCommandBuffer) \
+  X(CmdPipelineBarrier) \
+  X(CmdCopyBufferToImage) \
+  X(CmdCopyImageToBuffer) \
+  X(CmdBlitImage) \
+  X(CmdBeginRenderPass) \
+  X(CmdEndRenderPass) \
+  X(CmdBindPipeline) \
+  X(CmdBindDescriptorSets) \
+  X(CmdBindVertexBuffers) \
+  X(CmdBindIndexBuffer) \
+  X(CmdSetViewport) \
+  X(CmdSetScissor) \
+  X(CmdPushConstants) \
+  X(CmdDraw) \
+  X(CmdDrawIndexedIndirect)
+
+// Extensions and 1.2 entry points; the matching feature is cleared when
+// one is missing.
+#define CR_VK_DEVICE_OPTIONAL_FUNCS(X) \
+  X(CreateSwapchainKHR) \
+  X(DestroySwapchainKHR) \
+  X(GetSwapchainImagesKHR) \
+  X(AcquireNextImageKHR) \
+  X(QueuePresentKHR) \
+  X(CmdDrawIndexedIndirectCount) \
+  X(GetMemoryHostPointerPropertiesEXT)
+
+#define _CR_VK_MEMBER(name) PFN_vk##name name;
+
+struct cr_dispatch_t {
+  // Handle of the runtime-loaded loader library, NULL when the caller
+  // passed its own vkGetInstanceProcAddr.
+  void* loader;
+  PFN_vkGetInstanceProcAddr GetInstanceProcAddr;
+
+  CR_VK_GLOBAL_FUNCS(_CR_VK_MEMBER)
+  CR_VK_INSTANCE_FUNCS(_CR_VK_MEMBER)
+  CR_VK_INSTANCE_OPTIONAL_FUNCS(_CR_VK_MEMBER)
+  CR_VK_DEVICE_FUNCS(_CR_VK_MEMBER)
+  CR_VK_DEVICE_OPTIONAL_FUNCS(_CR_VK_MEMBER)
+};
+
+// Resolves the global entry points through `get_instance_proc_addr`, or
+// through the one exported by libvulkan.so.1 when NULL.
+bool cr_dispatch_load(struct cr_context_t* ctx, PFN_vkGetInstanceProcAddr get_instance_proc_addr);
+// Called once ctx->instance and ctx->logical_dev exist.
+bool cr_dispatch_load_instance(struct cr_context_t* ctx);
+bool cr_dispatch_load_device(struct cr_context_t* ctx);
+// Closes the loader library; called after the instance is destroyed.
+void cr_dispatch_unload(struct cr_context_t* ctx);
@@ -0,0 +1,120 @@
+#pragma once
+#include "corender.h"
+#include "memory.h"
+#include "occlusion.h"
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+
+// Offset of the first VkDrawIndexedIndirectCommand inside a region of a
+// per-frame command buffer; the draw count lives at offset 0. Each record
+// in a frame gets its own region, so a list can be drawn on every output.
+#define CR_DRAW_LIST_CMD_OFFSET 16
+
+// One bit per frame in flight, see `cr_draw_list_t.stale`.
+#define CR_DRAW_LIST_ALL_FRAMES ((1u << CR_FRAME_COUNT) - 1)
+
+#define CR_DRAW_OBJECT_INVALID UINT32_MAX
+
+// Mirrors the std430 layout of the object buffer read by shaders. The
+// buffer holds one copy of every object per frame in flight; the culled
+// draw for object `i` in frame `f` uses firstInstance = f * capacity + i,
+// so shaders fetch their object through gl_InstanceIndex. Draw lists
+// therefore require the drawIndirectFirstInstance device feature.
+struct cr_draw_object_t {
+  float x, y, w, h;
+
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  uint32_t flags;
+
+  // Bounds of the part not covered by opaque objects above, set by
+  // occlusion culling and equal to x, y, w, h otherwise. Indirect draws
+  // share one scissor, so shaders clamp to this instead.
+  float clip_x, clip_y, clip_w, clip_h;
+};
+
+enum cr_draw_object_flags_t {
+  CR_DRAW_OBJECT_ACTIVE = 1 << 0,
+  CR_DRAW_OBJECT_HIDDEN = 1 << 1,
+  // Hides objects with lower ids under its rect once occlusion is enabled.
+  CR_DRAW_OBJECT_OPAQUE = 1 << 2,
+  // Set by occlusion culling; the object is skipped until uncovered.
+  CR_DRAW_OBJECT_OCCLUDED = 1 << 3,
+};
+
+struct cr_draw_retired_id_t {
+  uint32_t id;
+  uint64_t frame_no;
+};
+
+struct cr_draw_list_t {
+  struct cr_context_t* ctx;
+
+  // CPU copy of the object buffer, walked by the visibility pass.
+  struct cr_draw_object_t* objects;
+  uint32_t n_objects, capacity;
+
+  uint32_t* free_ids;
+  uint32_t n_free;
+
+  // Removed ids with the frame that removed them, reused once the GPU has
+  // finished that frame.
+  struct cr_draw_retired_id_t* retired;
+  uint32_t retired_head, n_retired;
+
+  // Frames whose copy of an object is out of date, one bit per frame.
+  // Copies are only written when their frame is recorded, after the GPU
+  // released it.
+  uint8_t* stale;
+
+  struct cr_buffer_t object_buf;
+  struct cr_buffer_t cmd_bufs[CR_FRAME_COUNT];
+  // Indirect regions used in the frame being built.
+  uint64_t record_no;
+  uint32_t n_records;
+
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+  VkDescriptorSet set;
+  VkBuffer vertex_buf, index_buf;
+  VkIndexType index_type;
+
+  uint32_t n_visible;
+
+  // Set by cr_draw_list_enable_occlusion.
+  struct cr_occlusion_t* occlusion;
+
+  // Set while the owning context captures API calls.
+  struct cr_capture_t* capture;
+  uint32_t capture_id;
+};
+
+bool cr_draw_list_create(struct cr_context_t* ctx, struct cr_draw_list_t* o_list, uint32_t capacity);
+void cr_draw_list_destroy(struct cr_context_t* ctx, struct cr_draw_list_t* list);
+
+// Indexes the list's objects in a grid over `extent` so objects hidden by
+// CR_DRAW_OBJECT_OPAQUE objects above them are culled before the draw.
+bool cr_draw_list_enable_occlusion(struct cr_context_t* ctx, struct cr_draw_list_t* list, VkExtent2D extent);
+
+uint32_t cr_draw_list_add(struct cr_draw_list_t* list, const struct cr_draw_object_t* obj);
+void cr_draw_list_update(struct cr_draw_list_t* list, uint32_t id, const struct cr_draw_object_t* obj);
+void cr_draw_list_remove(struct cr_draw_list_t* list, uint32_t id);
+
+void cr_draw_list_bind(
+  struct cr_draw_list_t* list,
+  VkPipeline pipeline,
+  VkPipelineLayout layout,
+  VkDescriptorSet set,
+  VkBuffer vertex_buf,
+  VkBuffer index_buf,
+  VkIndexType index_type);
+
+// Culls the list against `rect` into the frame's indirect buffer and
+// records the indirect draw. Must be called inside a render pass.
+bool cr_draw_list_record(
+  struct cr_context_t* ctx,
+  struct cr_draw_list_t* list,
+  VkCommandBuffer cmd,
+  uint32_t frame_idx,
+  VkRect2D rect);
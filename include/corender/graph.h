@@ -0,0 +1,151 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+#define CR_GRAPH_MAX_PASSES      32
+#define CR_GRAPH_MAX_RESOURCES   32
+#define CR_GRAPH_MAX_USES        8
+#define CR_GRAPH_MAX_ATTACHMENTS 4
+// Framebuffers cached per pass, one per distinct set of imported views
+// (i.e. per swapchain image).
+#define CR_GRAPH_MAX_FRAMEBUFFERS 8
+
+#define CR_GRAPH_NONE UINT32_MAX
+
+enum cr_graph_access_t {
+  // Attachment writes; the pass becomes a render pass over them.
+  CR_GRAPH_ACCESS_COLOR_WRITE = 0,
+  CR_GRAPH_ACCESS_DEPTH_WRITE,
+  // Sampled from fragment shaders.
+  CR_GRAPH_ACCESS_SAMPLED,
+  CR_GRAPH_ACCESS_TRANSFER_SRC,
+  CR_GRAPH_ACCESS_TRANSFER_DST,
+};
+
+struct cr_graph_use_t {
+  uint32_t res;
+  enum cr_graph_access_t access;
+};
+
+struct cr_graph_pass_t;
+
+// Records the pass. For passes with attachments it runs inside the
+// pass's render pass, whose area is `pass->extent`.
+typedef bool (*cr_graph_exec_func_t)(
+  struct cr_context_t* ctx,
+  VkCommandBuffer cmd,
+  const struct cr_graph_pass_t* pass,
+  void* userdata);
+
+struct cr_graph_pass_t {
+  const char* name;
+  struct cr_graph_use_t uses[CR_GRAPH_MAX_USES];
+  uint32_t n_uses;
+
+  // Attachments are cleared instead of loaded when set.
+  bool clear;
+  VkClearColorValue clear_color;
+
+  cr_graph_exec_func_t exec;
+  void* userdata;
+
+  // Set by cr_graph_compile. Pipelines drawing in the pass are built
+  // against `render_pass`.
+  bool culled;
+  VkRenderPass render_pass;
+  VkExtent2D extent;
+  uint32_t n_attachments;
+  uint32_t attachments[CR_GRAPH_MAX_ATTACHMENTS];
+
+  VkImageView fb_views[CR_GRAPH_MAX_FRAMEBUFFERS][CR_GRAPH_MAX_ATTACHMENTS];
+  VkFramebuffer fbs[CR_GRAPH_MAX_FRAMEBUFFERS];
+  uint32_t n_fbs;
+};
+
+struct cr_graph_resource_t {
+  const char* name;
+  VkFormat fmt;
+  VkExtent2D extent;
+
+  // Imported images are owned by the caller (e.g. the swapchain image)
+  // and set per frame with cr_graph_set_image.
+  bool imported;
+  VkImageLayout initial_layout, final_layout;
+  // Kept alive by culling even when no pass reads it.
+  bool output;
+
+  VkImage image;
+  VkImageView view;
+
+  // Set by cr_graph_compile.
+  VkImageUsageFlags usage;
+  uint32_t first_pass, last_pass;
+  uint32_t block;
+
+  // Tracked while executing.
+  VkImageLayout layout;
+  VkAccessFlags access;
+  VkPipelineStageFlags stage;
+};
+
+// Device memory shared by transient images with disjoint lifetimes.
+struct cr_graph_block_t {
+  VkDeviceMemory mem;
+  VkDeviceSize size, align;
+  uint32_t type_bits, type;
+  bool lazy;
+
+  VkAccessFlags access;
+  VkPipelineStageFlags stage;
+};
+
+struct cr_graph_t {
+  struct cr_graph_pass_t passes[CR_GRAPH_MAX_PASSES];
+  uint32_t n_passes;
+
+  struct cr_graph_resource_t resources[CR_GRAPH_MAX_RESOURCES];
+  uint32_t n_resources;
+
+  struct cr_graph_block_t blocks[CR_GRAPH_MAX_RESOURCES];
+  uint32_t n_blocks;
+
+  bool compiled;
+
+  // Statistics of the last compile and execution.
+  uint32_t n_culled, n_barriers;
+  VkDeviceSize transient_size, aliased_size;
+};
+
+void cr_graph_init(struct cr_graph_t* o_graph);
+
+// Returns CR_GRAPH_NONE when the graph is full.
+uint32_t cr_graph_create_image(struct cr_graph_t* graph, const char* name, VkFormat fmt, VkExtent2D extent);
+uint32_t cr_graph_import_image(
+  struct cr_graph_t* graph,
+  const char* name,
+  VkFormat fmt,
+  VkExtent2D extent,
+  VkImageLayout initial_layout,
+  VkImageLayout final_layout);
+void cr_graph_set_image(struct cr_graph_t* graph, uint32_t res, VkImage image, VkImageView view);
+void cr_graph_mark_output(struct cr_graph_t* graph, uint32_t res);
+
+uint32_t cr_graph_add_pass(struct cr_graph_t* graph, const char* name, cr_graph_exec_func_t exec, void* userdata);
+bool cr_graph_pass_use(struct cr_graph_t* graph, uint32_t pass, uint32_t res, enum cr_graph_access_t access);
+void cr_graph_pass_clear(struct cr_graph_t* graph, uint32_t pass, VkClearColorValue color);
+
+// Culls passes that contribute to no output, creates and aliases the
+// transient images and builds a render pass per attachment pass. Compiling
+// again retires what the previous compile created; pipelines built
+// against its render passes must be rebuilt.
+bool cr_graph_compile(struct cr_context_t* ctx, struct cr_graph_t* graph);
+
+// Records every live pass with the barriers between them. Imported
+// images are left in their final layout.
+bool cr_graph_execute(struct cr_context_t* ctx, struct cr_graph_t* graph, VkCommandBuffer cmd);
+
+// Retires the graph's objects through the context's deletion queue.
+void cr_graph_destroy(struct cr_context_t* ctx, struct cr_graph_t* graph);
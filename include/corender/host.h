@@ -0,0 +1,98 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+// Backing allocator for all host memory corender and the Vulkan driver
+// allocate through the context. Must return memory aligned like malloc
+// (larger alignments are handled on top) and be thread-safe, as the driver
+// and the init worker allocate concurrently. Defaults to malloc/free.
+struct cr_allocator_t {
+  void* (*alloc)(size_t size, void* userdata);
+  void  (*free)(void* ptr, void* userdata);
+  void* userdata;
+};
+
+struct cr_host_info_t {
+  struct cr_allocator_t allocator;
+  // Tracked allocations beyond this many live bytes fail (driver calls then
+  // return VK_ERROR_OUT_OF_HOST_MEMORY). 0 disables the limit.
+  size_t budget;
+};
+
+struct cr_host_alloc_stats_t {
+  uint64_t n_allocs, n_reallocs, n_frees;
+  uint64_t live_allocs;
+  size_t live_bytes, peak_bytes;
+};
+
+struct cr_host_stats_t {
+  // corender's own allocations, arena blocks included.
+  struct cr_host_alloc_stats_t corender;
+  // Driver allocations through VkAllocationCallbacks, per
+  // VkSystemAllocationScope.
+  struct cr_host_alloc_stats_t driver[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+  // Memory the driver allocated itself and only reported.
+  size_t driver_internal_bytes;
+
+  size_t live_bytes, peak_bytes;
+  uint64_t n_failed;
+};
+
+struct cr_arena_block_t;
+
+// Linear allocator over a chain of blocks. Allocations are zeroed and only
+// released all at once by cr_arena_reset or cr_arena_destroy.
+struct cr_arena_t {
+  struct cr_context_t* ctx;
+  struct cr_arena_block_t *head, *crnt;
+  size_t block_size;
+
+  // Bytes handed out since the last reset, and the most ever handed out.
+  size_t used, peak;
+  size_t reserved;
+};
+
+struct cr_host_t {
+  struct cr_allocator_t allocator;
+  size_t budget;
+
+  // Guards `stats`; the driver may allocate from any thread.
+  pthread_mutex_t lock;
+  struct cr_host_stats_t stats;
+
+  VkAllocationCallbacks vk;
+  // Passed to every vkCreate*/vkDestroy*/vkAllocateMemory corender calls.
+  // Objects handed to cr_deletion_push must be created with it as well.
+  const VkAllocationCallbacks* vk_alloc;
+
+  // Init-time arrays living as long as the context.
+  struct cr_arena_t arena;
+
+  bool initialized;
+};
+
+bool cr_host_init(struct cr_context_t* ctx, const struct cr_host_info_t* info);
+// Reports leaked allocations and releases the context arena.
+void cr_host_destroy(struct cr_context_t* ctx);
+
+void* cr_host_alloc(struct cr_context_t* ctx, size_t size);
+void* cr_host_calloc(struct cr_context_t* ctx, size_t n, size_t size);
+void* cr_host_realloc(struct cr_context_t* ctx, void* ptr, size_t size);
+void  cr_host_free(struct cr_context_t* ctx, void* ptr);
+
+void cr_host_get_stats(struct cr_context_t* ctx, struct cr_host_stats_t* o_stats);
+
+void  cr_arena_init(struct cr_context_t* ctx, struct cr_arena_t* o_arena, size_t block_size);
+void* cr_arena_alloc(struct cr_arena_t* arena, size_t size, size_t align);
+// Keeps the blocks for reuse.
+void  cr_arena_reset(struct cr_arena_t* arena);
+void  cr_arena_destroy(struct cr_arena_t* arena);
+
+// Zeroed scratch memory valid until the frame being built is begun again,
+// i.e. CR_FRAME_COUNT frames later. Usable during init as well.
+void* cr_frame_scratch_alloc(struct cr_context_t* ctx, size_t size, size_t align);
@@ -0,0 +1,144 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+
+struct cr_context_t;
+
+enum cr_memory_pressure_t {
+  CR_MEMORY_PRESSURE_NONE = 0,
+  CR_MEMORY_PRESSURE_WARN,
+  CR_MEMORY_PRESSURE_CRITICAL
+};
+
+struct cr_memory_heap_stats_t {
+  VkDeviceSize size;
+  // Bytes this process may use on the heap, as reported by
+  // VK_EXT_memory_budget or estimated from the heap size without it.
+  VkDeviceSize budget;
+  // Process-wide usage of the heap, including allocations made outside
+  // corender (driver internals, other libraries).
+  VkDeviceSize usage;
+  // Bytes allocated through corender.
+  VkDeviceSize own;
+  uint32_t n_allocs;
+  bool device_local;
+  enum cr_memory_pressure_t pressure;
+};
+
+struct cr_memory_stats_t {
+  uint32_t n_heaps;
+  struct cr_memory_heap_stats_t heaps[VK_MAX_MEMORY_HEAPS];
+  // False when budget and usage are estimates (no VK_EXT_memory_budget).
+  bool budget_ext;
+};
+
+// Raised whenever the pressure level of a heap changes, and with
+// CR_MEMORY_PRESSURE_CRITICAL before an allocation that ran out of device
+// memory is retried, so caches can evict in the callback. Resources evicted
+// there are retired with the frame being built, so they only make room for
+// allocations after that frame completes, not for the retry.
+typedef void (*cr_memory_pressure_func_t)(
+  struct cr_context_t* ctx,
+  uint32_t heap,
+  enum cr_memory_pressure_t pressure,
+  const struct cr_memory_heap_stats_t* stats,
+  void* userdata);
+
+struct cr_memory_pressure_info_t {
+  // Fractions of the heap budget, default to 0.8 and 0.95 when zero.
+  float warn_threshold, critical_threshold;
+  cr_memory_pressure_func_t callback;
+  void* userdata;
+};
+
+struct cr_memory_t {
+  struct cr_memory_stats_t stats;
+  struct cr_memory_pressure_info_t pressure;
+};
+
+struct cr_buffer_t {
+  VkBuffer handle;
+  VkDeviceMemory mem;
+  VkDeviceSize size;
+  // Size and type of the backing allocation, for budget tracking.
+  VkDeviceSize mem_size;
+  uint32_t mem_type;
+
+  // Non-NULL when the buffer lives in host-visible memory, mapped
+  // for the whole lifetime of the buffer.
+  void* mapped;
+};
+
+bool cr_memory_find_type(
+  struct cr_context_t* ctx,
+  uint32_t type_bits,
+  VkMemoryPropertyFlags props,
+  uint32_t* o_type);
+
+bool cr_memory_init(struct cr_context_t* ctx, const struct cr_memory_pressure_info_t* pressure);
+
+// Refreshes heap budgets and usage and raises pressure callbacks.
+// Called once per frame by cr_frame_begin.
+void cr_memory_update_budget(struct cr_context_t* ctx);
+
+void cr_memory_get_stats(struct cr_context_t* ctx, struct cr_memory_stats_t* o_stats);
+
+// Allocates device memory of a type matching `reqs` and `props`. On
+// VK_ERROR_OUT_OF_DEVICE_MEMORY the pressure callback is raised, every
+// submitted frame is waited for, objects retired by those frames are
+// destroyed and the allocation retried once.
+bool cr_memory_alloc(
+  struct cr_context_t* ctx,
+  const VkMemoryRequirements* reqs,
+  VkMemoryPropertyFlags props,
+  VkDeviceMemory* o_mem,
+  uint32_t* o_type);
+
+// cr_memory_alloc with a pNext chain for VkMemoryAllocateInfo, e.g. to
+// import external memory.
+bool cr_memory_alloc_chained(
+  struct cr_context_t* ctx,
+  const VkMemoryRequirements* reqs,
+  VkMemoryPropertyFlags props,
+  const void* next,
+  VkDeviceMemory* o_mem,
+  uint32_t* o_type);
+
+void cr_memory_free(struct cr_context_t* ctx, VkDeviceMemory mem, VkDeviceSize size, uint32_t type);
+
+bool cr_buffer_create(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags props);
+
+// Creates a persistently mapped buffer, preferring device-local host-visible
+// memory (resizable BAR) and falling back to plain host-visible memory when
+// the buffer's type bits exclude it or its heap is full. Buffers over 1 MiB
+// always go to plain host-visible memory.
+bool cr_buffer_create_mapped(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage);
+
+// Creates a persistently mapped buffer in plain host-visible memory, for
+// upload and one-off staging buffers the GPU reads once.
+bool cr_buffer_create_staging(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage);
+
+void cr_buffer_destroy(struct cr_context_t* ctx, struct cr_buffer_t* buf);
+
+// Sub-allocates from the upload memory of the frame currently being built,
+// waiting for the GPU to release that frame first. Returns a mapped pointer
+// or NULL when the frame's upload memory is exhausted.
+void* cr_frame_upload_alloc(
+  struct cr_context_t* ctx,
+  VkDeviceSize size,
+  VkDeviceSize align,
+  VkBuffer* o_buf,
+  VkDeviceSize* o_offset);
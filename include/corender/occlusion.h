@@ -0,0 +1,70 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+struct cr_draw_list_t;
+struct cr_draw_object_t;
+
+#define CR_OCCLUSION_CELL_SIZE 128
+// Changed regions tracked between updates; more trigger a full pass.
+#define CR_OCCLUSION_MAX_DIRTY 64
+// Visible pieces tracked per object while occluders are subtracted.
+// Objects whose visible region splits further are kept as they are.
+#define CR_OCCLUSION_MAX_PIECES 32
+
+struct cr_occlusion_rect_t {
+  float x0, y0, x1, y1;
+};
+
+struct cr_occlusion_cell_t {
+  uint32_t* ids;
+  uint32_t n, cap;
+};
+
+// Uniform grid over the draw list's objects. Objects are composited in id
+// order, so an opaque object hides whatever lower ids lie under it.
+struct cr_occlusion_t {
+  struct cr_context_t* ctx;
+
+  // Objects outside the grid land in its border cells.
+  uint32_t cell_size, n_cols, n_rows;
+  struct cr_occlusion_cell_t* cells;
+
+  // Per object, the last pass that visited it and the last object whose
+  // occluders included it, so overlapping cells count it once.
+  uint32_t* visited;
+  uint32_t* tested;
+  uint32_t visit_stamp, test_stamp;
+  uint32_t capacity;
+
+  struct cr_occlusion_rect_t dirty[CR_OCCLUSION_MAX_DIRTY];
+  uint32_t n_dirty;
+  bool full;
+
+  // Objects currently dropped or clipped.
+  uint32_t n_occluded, n_clipped;
+  uint64_t n_resolved;
+};
+
+bool cr_occlusion_init(
+  struct cr_context_t* ctx,
+  struct cr_occlusion_t* o_occ,
+  uint32_t capacity,
+  VkExtent2D extent);
+void cr_occlusion_destroy(struct cr_occlusion_t* occ);
+
+// Moves object `id` from `prev` to `next` in the grid, either NULL when the
+// object is added or removed, and marks both rects for the next update.
+void cr_occlusion_move(
+  struct cr_occlusion_t* occ,
+  uint32_t id,
+  const struct cr_draw_object_t* prev,
+  const struct cr_draw_object_t* next);
+
+// Recomputes visibility of the objects under changed regions: objects
+// fully covered by opaque objects above them get CR_DRAW_OBJECT_OCCLUDED,
+// the others a clip rect bounding their visible part. Called by
+// cr_draw_list_record before culling.
+void cr_occlusion_update(struct cr_occlusion_t* occ, struct cr_draw_list_t* list);
@@ -0,0 +1,25 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct cr_context_t;
+
+// Pipeline cache persisted between runs, so pipelines created at startup
+// skip shader compilation in the driver after the first launch.
+struct cr_pipeline_cache_t {
+  VkPipelineCache handle;
+  // Empty when the cache is not persisted.
+  char path[512];
+  size_t loaded_size;
+};
+
+// Loads `path` into a new VkPipelineCache, or $XDG_CACHE_HOME/corender/
+// pipeline.cache when `path` is NULL. A missing, stale or foreign cache
+// file yields an empty cache. Safe to call from a worker thread.
+bool cr_pipeline_cache_load(struct cr_context_t* ctx, struct cr_pipeline_cache_t* o_cache, const char* path);
+
+// Writes the cache back to its file.
+bool cr_pipeline_cache_save(struct cr_context_t* ctx, struct cr_pipeline_cache_t* cache);
+
+void cr_pipeline_cache_destroy(struct cr_context_t* ctx, struct cr_pipeline_cache_t* cache);
@@ -0,0 +1,75 @@
+#pragma once
+#include "memory.h"
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+#define CR_READBACK_RING_SIZE 3
+
+enum cr_readback_slot_state_t {
+  CR_READBACK_SLOT_FREE = 0,
+  CR_READBACK_SLOT_PENDING,
+  CR_READBACK_SLOT_READY,
+  CR_READBACK_SLOT_ACQUIRED
+};
+
+struct cr_readback_slot_t {
+  struct cr_buffer_t buf;
+  enum cr_readback_slot_state_t state;
+
+  // Submission that copies into this slot and the frame whose fence
+  // signals its completion.
+  uint64_t frame_no;
+  uint32_t frame_idx;
+
+  uint32_t width, height;
+};
+
+struct cr_readback_image_t {
+  const void* pixels;
+  uint32_t width, height, stride;
+  VkFormat fmt;
+  uint64_t frame_no;
+  uint32_t slot;
+};
+
+struct cr_readback_t {
+  struct cr_readback_slot_t slots[CR_READBACK_RING_SIZE];
+  uint32_t next;
+
+  bool initialized;
+  bool coherent;
+  VkMemoryPropertyFlags props;
+
+  // One-shot capture of the next frame, or every frame while recording.
+  bool requested, continuous;
+
+  uint64_t n_captured, n_dropped;
+};
+
+bool cr_readback_init(struct cr_context_t* ctx);
+void cr_readback_destroy(struct cr_context_t* ctx);
+// Retires the buffers of free slots so they are recreated at the primary
+// output's next size. Called when that output is resized.
+void cr_readback_invalidate(struct cr_context_t* ctx);
+
+// Requests a copy of the next presented image, or of every presented image
+// while `continuous` is set. Never blocks; frames are dropped (and counted)
+// while all slots are still in flight or held by the caller.
+void cr_readback_request(struct cr_context_t* ctx, bool continuous);
+
+// Hands out the oldest finished capture as a pointer into mapped memory.
+// Returns false if none is ready. The slot stays owned by the caller until
+// cr_readback_release().
+bool cr_readback_acquire(struct cr_context_t* ctx, struct cr_readback_image_t* o_img);
+void cr_readback_release(struct cr_context_t* ctx, const struct cr_readback_image_t* img);
+
+// Records the copy of `image` (in the swapchain's final layout) into a free slot.
+// Called by cr_draw_frame after the render pass.
+bool cr_readback_record(
+  struct cr_context_t* ctx,
+  VkCommandBuffer cmd,
+  VkImage image,
+  uint32_t frame_idx);
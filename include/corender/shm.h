@@ -0,0 +1,68 @@
+#pragma once
+#include "memory.h"
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+// Pixels of a client in shared memory (e.g. a wl_shm pool), with 4 bytes
+// per pixel. With VK_EXT_external_memory_host the mapping is wrapped as a
+// VkBuffer and the GPU reads it in place; otherwise updates are memcpy'd
+// into upload memory first.
+struct cr_shm_buffer_t {
+  const uint8_t* ptr;
+  size_t size;
+  VkExtent2D extent;
+  uint32_t stride;
+  VkFormat fmt;
+
+  // Set when `buf` wraps the client memory; `offset` is where `ptr` starts
+  // within it, as the import is widened to the device's alignment.
+  bool imported;
+  struct cr_buffer_t buf;
+  VkDeviceSize offset;
+
+  // Imported buffers are also exposed as a uniform texel buffer when the
+  // format and limits allow, so shaders can fetch pixels without a copy
+  // (texel index: y * stride / 4 + x).
+  VkBufferView texel_view;
+
+  // Submission that last read the memory.
+  uint64_t last_use_no;
+};
+
+// Never fails over a missing extension or a misaligned region, it falls
+// back to copies instead; false only on invalid arguments or Vulkan errors.
+bool cr_shm_import(
+  struct cr_context_t* ctx,
+  struct cr_shm_buffer_t* o_shm,
+  const void* ptr,
+  size_t size,
+  VkExtent2D extent,
+  uint32_t stride,
+  VkFormat fmt);
+
+// Records a copy of the `damage` rectangle into `dst`, which must be in
+// VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL (e.g. inside a render graph pass
+// using CR_GRAPH_ACCESS_TRANSFER_DST).
+bool cr_shm_record_copy(
+  struct cr_context_t* ctx,
+  VkCommandBuffer cmd,
+  struct cr_shm_buffer_t* shm,
+  VkImage dst,
+  VkRect2D damage);
+
+// Marks the memory as read by the frame being built, for draws sampling
+// `texel_view` directly.
+void cr_shm_mark_used(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm);
+
+// True while a submitted frame may still read the memory. Clients must not
+// get their buffer back (wl_buffer.release) before this turns false.
+bool cr_shm_busy(struct cr_context_t* ctx, const struct cr_shm_buffer_t* shm);
+
+// Retires the import through the deletion queue. Only `last_use_no` is
+// kept: an imported mapping must stay mapped until cr_shm_busy on the
+// released buffer turns false, as the driver references it until then.
+void cr_shm_release(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm);
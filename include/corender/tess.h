@@ -0,0 +1,91 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+#define CR_TESS_MAX_SEGMENTS 16
+
+enum cr_tess_backend_t {
+  CR_TESS_BACKEND_AUTO = 0,
+  CR_TESS_BACKEND_SCALAR,
+  CR_TESS_BACKEND_SSE2,
+  CR_TESS_BACKEND_AVX2,
+  CR_TESS_BACKEND_COUNT
+};
+
+enum cr_tess_stream_t {
+  CR_TESS_STREAM_X = 0,
+  CR_TESS_STREAM_Y,
+  CR_TESS_STREAM_ALPHA,
+  CR_TESS_STREAM_COLOR,
+  CR_TESS_STREAM_INDEX,
+  CR_TESS_STREAM_COUNT
+};
+
+struct cr_tess_rect_t {
+  float x, y, w, h;
+};
+
+// Vertices are emitted as structure-of-arrays streams, each bound as its own
+// vertex buffer at `offsets[stream]` of `buf`. `alpha` is the coverage of a
+// vertex and drops to 0 on the anti-aliased fringe.
+struct cr_tess_batch_t {
+  float* x;
+  float* y;
+  float* alpha;
+  uint32_t* color;
+  uint32_t* indices;
+
+  uint32_t n_verts, cap_verts;
+  uint32_t n_indices, cap_indices;
+
+  // Set when a primitive did not fit; that primitive was dropped.
+  bool overflow;
+
+  VkBuffer buf;
+  VkDeviceSize offsets[CR_TESS_STREAM_COUNT];
+};
+
+// Places the batch streams in the upload memory of the frame being built.
+bool cr_tess_batch_begin(
+  struct cr_context_t* ctx,
+  struct cr_tess_batch_t* o_batch,
+  uint32_t max_verts,
+  uint32_t max_indices);
+
+// Places the batch streams in caller-owned memory of at least
+// cr_tess_batch_mem_size() bytes, aligned to 32 bytes.
+size_t cr_tess_batch_mem_size(uint32_t max_verts, uint32_t max_indices);
+void   cr_tess_batch_init(
+  struct cr_tess_batch_t* o_batch,
+  void* mem,
+  uint32_t max_verts,
+  uint32_t max_indices);
+
+// Selects the SIMD kernel; returns false if the CPU lacks support for it.
+bool cr_tess_set_backend(enum cr_tess_backend_t backend);
+enum cr_tess_backend_t cr_tess_get_backend(void);
+const char* cr_tess_backend_name(enum cr_tess_backend_t backend);
+
+void cr_tess_rounded_rect(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  uint32_t color);
+
+void cr_tess_border(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  float width,
+  uint32_t color);
+
+void cr_tess_shadow(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  float blur,
+  uint32_t color);
@@ -0,0 +1,115 @@
+#pragma once
+#include "atlas.h"
+#include "corender.h"
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+// Shaped strings kept before the cache drops those not drawn this frame.
+#define CR_TEXT_SHAPE_CACHE_SIZE 512
+
+// Coverage of one glyph as produced by the rasterizer. Pixels are 8-bit
+// alpha (or a signed distance field; the shaders decide how to read it).
+struct cr_glyph_bitmap_t {
+  uint32_t width, height, stride;
+  const uint8_t* pixels;
+  // Offset of the bitmap's top-left corner from the pen position on the
+  // baseline, y pointing down.
+  int32_t bearing_x, bearing_y;
+  float advance;
+};
+
+// Rasterizes `codepoint` of `font` at `size` pixels, e.g. with FreeType.
+// The bitmap only has to stay valid until the callback returns again.
+typedef bool (*cr_text_rasterize_func_t)(
+  uint32_t font,
+  float size,
+  uint32_t codepoint,
+  struct cr_glyph_bitmap_t* o_glyph,
+  void* userdata);
+
+// Mirrors the per-instance vertex input the text pipeline reads from
+// binding 0 (VK_VERTEX_INPUT_RATE_INSTANCE): one quad per glyph, drawn as
+// a 4 vertex triangle strip. `page` indexes the combined image sampler
+// array at set 0, binding 0; the render area's width and height are pushed
+// as two floats at offset 0 for the vertex stage.
+struct cr_text_instance_t {
+  float x, y, w, h;
+  float uv[4];
+  float color[4];
+  uint32_t page;
+  uint32_t pad[3];
+};
+
+struct cr_text_glyph_t;
+struct cr_text_shape_t;
+
+struct cr_text_t {
+  // Glyph coverage, keyed by font, size and codepoint.
+  struct cr_atlas_t atlas;
+
+  cr_text_rasterize_func_t rasterize;
+  void* userdata;
+
+  // Metrics of every glyph seen, kept when the atlas evicts its pixels.
+  struct cr_text_glyph_t* glyphs;
+  uint32_t n_glyphs, glyph_cap;
+
+  // Glyph runs per (font, size, string).
+  struct cr_text_shape_t* shapes;
+  uint32_t n_shapes, shape_cap;
+
+  // Instances queued for the frame being built.
+  struct cr_text_instance_t* instances;
+  uint32_t n_instances, instance_cap;
+
+  // Queue uploaded by the first record of submission `record_no`, drawn
+  // again by every other output recorded in that frame.
+  uint64_t record_no;
+  VkBuffer record_buf;
+  VkDeviceSize record_offset;
+  uint32_t n_recorded;
+
+  // One set per frame in flight, rewritten when pages were added since.
+  VkDescriptorSetLayout set_layout;
+  VkDescriptorPool pool;
+  VkDescriptorSet sets[CR_FRAME_COUNT];
+  uint32_t set_pages[CR_FRAME_COUNT];
+  VkSampler sampler;
+
+  VkPipeline pipeline;
+  VkPipelineLayout layout;
+
+  uint64_t n_rasterized;
+  uint64_t n_shape_hits, n_shape_misses;
+};
+
+bool cr_text_create(
+  struct cr_context_t* ctx,
+  struct cr_text_t* o_text,
+  cr_text_rasterize_func_t rasterize,
+  void* userdata);
+void cr_text_destroy(struct cr_context_t* ctx, struct cr_text_t* text);
+
+// The pipeline's layout must use `text->set_layout` as set 0.
+void cr_text_bind(struct cr_text_t* text, VkPipeline pipeline, VkPipelineLayout layout);
+
+// Queues `str` (UTF-8) with its pen starting at `x`, baseline `y`, for the
+// frame being built. Once the string and its glyphs are cached this only
+// appends instances.
+bool cr_text_draw(
+  struct cr_context_t* ctx,
+  struct cr_text_t* text,
+  uint32_t font,
+  float size,
+  const char* str,
+  float x,
+  float y,
+  const float color[4]);
+
+// Records every queued glyph as a single instanced draw. The queue is
+// cleared by the first record of a frame; recording on more outputs in the
+// same frame draws the same glyphs. Must be called inside a render pass.
+bool cr_text_record(struct cr_context_t* ctx, struct cr_text_t* text, VkCommandBuffer cmd, VkRect2D rect);
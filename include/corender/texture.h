@@ -0,0 +1,94 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cr_context_t;
+
+// Bytes of texture data uploaded per frame, half of the frame's upload
+// memory so draw lists keep the rest. Larger textures stream in over
+// several frames.
+#define CR_TEXTURE_UPLOAD_BUDGET (2u << 20)
+
+enum cr_texture_format_t {
+  CR_TEXTURE_FORMAT_RGBA8 = 0,
+  // Block-compressed, 4x4 pixel blocks of 8 (BC1) or 16 bytes.
+  CR_TEXTURE_FORMAT_BC1,
+  CR_TEXTURE_FORMAT_BC3,
+  CR_TEXTURE_FORMAT_BC7,
+};
+
+struct cr_texture_info_t {
+  enum cr_texture_format_t fmt;
+  bool srgb;
+  uint32_t width, height;
+
+  // `n_levels` mip levels, largest first and tightly packed: rows of
+  // pixels for RGBA8, rows of blocks for compressed formats. Copied, so it
+  // may be freed once cr_texture_create returns.
+  const void* data;
+  size_t size;
+  uint32_t n_levels;
+
+  // Generates the levels missing from `data` down to 1x1 on the GPU.
+  // Compressed textures cannot be blitted into and keep the levels they
+  // come with, unless they were decoded to RGBA8.
+  bool gen_mips;
+};
+
+struct cr_texture_t {
+  VkImage image;
+  VkImageView view;
+  VkDeviceMemory mem;
+  VkDeviceSize mem_size;
+  uint32_t mem_type;
+
+  VkFormat fmt;
+  VkExtent2D extent;
+  uint32_t n_levels;
+  // Levels uploaded from the data; the rest are blitted.
+  uint32_t n_data_levels;
+  // Format of the uploaded data. Set to RGBA8, with `decoded`, when
+  // compressed data was decoded because the device cannot sample it.
+  enum cr_texture_format_t data_fmt;
+  bool decoded;
+
+  // Host copy of the data, released once uploaded. Uploads advance level
+  // by level and, within a level, by rows of blocks.
+  uint8_t* staging;
+  size_t staging_offset;
+  uint32_t upload_level, upload_row;
+  bool upload_started;
+  struct cr_texture_t* next;
+
+  // Set once the upload and mip generation are recorded; draws recorded
+  // after it in the same frame may sample `view`.
+  bool ready;
+};
+
+// Textures waiting for upload, in creation order.
+struct cr_texture_uploads_t {
+  struct cr_texture_t *head, *tail;
+  uint64_t n_bytes;
+};
+
+// True when `fmt` can be sampled without decoding.
+bool cr_texture_format_supported(struct cr_context_t* ctx, enum cr_texture_format_t fmt, bool srgb);
+
+// Creates the image and queues its upload. BC1 and BC3 data is decoded to
+// RGBA8 when the device lacks support; unsupported BC7 data fails, callers
+// then have to provide RGBA8 themselves.
+bool cr_texture_create(
+  struct cr_context_t* ctx,
+  struct cr_texture_t* o_tex,
+  const struct cr_texture_info_t* info);
+
+// Records pending uploads into the frame's command buffer, up to
+// CR_TEXTURE_UPLOAD_BUDGET bytes. Called by cr_draw_frame before any
+// output is recorded.
+bool cr_texture_record_uploads(struct cr_context_t* ctx, VkCommandBuffer cmd);
+
+// Retires the texture through the deletion queue, cancelling a pending
+// upload.
+void cr_texture_destroy(struct cr_context_t* ctx, struct cr_texture_t* tex);
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <vulkan/vulkan_core.h>
 
 #define _CR_BRAND_NAME "corender"  
 #define _CR_VERSION "alpha 0.1"
@@ -100,3 +101,17 @@ enum cr_log_level_t {
 void cr_util_log_header(FILE* stream, enum cr_log_level_t lvl);
 
 char* cr_util_log_get_filepath();
+
+uint64_t cr_util_time_ns();
+
+#define _VK_CHECK(ctx, expr)                              \
+do {                                                      \
+  VkResult _res = (expr);                                 \
+  if (_res != VK_SUCCESS) {                               \
+    CR_ERROR(ctx->log, "Vulkan error: %s (%i) - %s failed.", \
+    cr_util_vk_result_to_string(_res), _res, #expr);       \
+    return false;                                         \
+  }                                                       \
+} while (0)
+
+const char* cr_util_vk_result_to_string(VkResult r);
@@ -0,0 +1,528 @@
+#include "../include/corender/atlas.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "ATLAS"
+
+#define _DEFAULT_PAGE_SIZE 1024
+#define _EMPTY UINT32_MAX
+
+struct cr_atlas_slot_t {
+  uint64_t key;
+  struct cr_atlas_entry_t entry;
+  uint64_t last_use_no;
+  // Next free slot while not live.
+  uint32_t next_free;
+  bool live;
+};
+
+static uint32_t _hash(uint64_t key, uint32_t cap);
+static bool     _table_rebuild(struct cr_context_t* ctx, struct cr_atlas_t* atlas, uint32_t cap);
+static uint32_t _table_find(const struct cr_atlas_t* atlas, uint64_t key);
+static bool     _create_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas);
+static void     _release_page(struct cr_context_t* ctx, struct cr_atlas_page_t* page);
+static void     _skyline_reset(struct cr_atlas_page_t* page, uint32_t size);
+static bool     _skyline_fit(const struct cr_atlas_page_t* page, uint32_t idx, uint32_t w, uint32_t h, uint32_t size, uint32_t* o_y);
+static bool     _skyline_pack(struct cr_atlas_page_t* page, uint32_t w, uint32_t h, uint32_t size, uint32_t* o_x, uint32_t* o_y);
+static bool     _evict_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas, uint32_t* o_page);
+static bool     _add_dirty(struct cr_context_t* ctx, struct cr_atlas_page_t* page, VkRect2D rect);
+static bool     _record_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas, struct cr_atlas_page_t* page, VkCommandBuffer cmd);
+
+uint32_t
+_hash(uint64_t key, uint32_t cap) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return (uint32_t)key & (cap - 1);
+}
+
+bool
+_table_rebuild(struct cr_context_t* ctx, struct cr_atlas_t* atlas, uint32_t cap) {
+  uint32_t* table = cr_host_alloc(ctx, cap * sizeof *table);
+  if(!table) return false;
+  memset(table, 0xff, cap * sizeof *table);
+
+  for(uint32_t i = 0; i < atlas->n_slots; i++) {
+    if(!atlas->slots[i].live) continue;
+    uint32_t t = _hash(atlas->slots[i].key, cap);
+    while(table[t] != _EMPTY) t = (t + 1) & (cap - 1);
+    table[t] = i;
+  }
+
+  cr_host_free(ctx, atlas->table);
+  atlas->table = table;
+  atlas->table_cap = cap;
+  return true;
+}
+
+uint32_t
+_table_find(const struct cr_atlas_t* atlas, uint64_t key) {
+  if(!atlas->table_cap) return _EMPTY;
+  for(uint32_t t = _hash(key, atlas->table_cap); atlas->table[t] != _EMPTY; t = (t + 1) & (atlas->table_cap - 1)) {
+    if(atlas->slots[atlas->table[t]].key == key) return atlas->table[t];
+  }
+  return _EMPTY;
+}
+
+bool
+_create_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas) {
+  struct cr_atlas_page_t* page = &atlas->pages[atlas->n_pages];
+  memset(page, 0, sizeof *page);
+
+  VkImageCreateInfo img_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = atlas->fmt,
+    .extent = { atlas->page_size, atlas->page_size, 1 },
+    .mipLevels = 1,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateImage(ctx->logical_dev, &img_info, ctx->host.vk_alloc, &page->image));
+
+  VkMemoryRequirements reqs;
+  ctx->vk.GetImageMemoryRequirements(ctx->logical_dev, page->image, &reqs);
+  if(!cr_memory_alloc(ctx, &reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &page->mem, &page->mem_type)) {
+    CR_ERROR(ctx->log, "Failed to allocate memory for atlas page %i", atlas->n_pages);
+    ctx->vk.DestroyImage(ctx->logical_dev, page->image, ctx->host.vk_alloc);
+    page->image = VK_NULL_HANDLE;
+    return false;
+  }
+  page->mem_size = reqs.size;
+
+  VkResult res = ctx->vk.BindImageMemory(ctx->logical_dev, page->image, page->mem, 0);
+  if(res != VK_SUCCESS) {
+    CR_ERROR(ctx->log, "Failed to bind memory for atlas page %i: %s", atlas->n_pages, cr_util_vk_result_to_string(res));
+    _release_page(ctx, page);
+    return false;
+  }
+
+  VkImageViewCreateInfo view_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image = page->image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = atlas->fmt,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = 1,
+      .layerCount = 1
+    }
+  };
+  res = ctx->vk.CreateImageView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &page->view);
+  if(res != VK_SUCCESS) {
+    CR_ERROR(ctx->log, "Failed to create view for atlas page %i: %s", atlas->n_pages, cr_util_vk_result_to_string(res));
+    page->view = VK_NULL_HANDLE;
+    _release_page(ctx, page);
+    return false;
+  }
+
+  // A skyline never has more segments than the page has columns, plus the
+  // one being inserted.
+  page->skyline = cr_host_alloc(ctx, (atlas->page_size + 1) * sizeof *page->skyline);
+  page->shadow = cr_host_calloc(ctx, (size_t)atlas->page_size * atlas->page_size, atlas->bpp);
+  if(!page->skyline || !page->shadow) {
+    CR_ERROR(ctx->log, "Failed to allocate host memory for atlas page %i", atlas->n_pages);
+    _release_page(ctx, page);
+    return false;
+  }
+  _skyline_reset(page, atlas->page_size);
+
+  // Only fully built pages are counted, and so ever bound or evicted.
+  atlas->n_pages++;
+
+  CR_TRACE(ctx->log, "Added atlas page %i (size: %i, format: %i)", atlas->n_pages - 1, atlas->page_size, atlas->fmt);
+  return true;
+}
+
+void
+_release_page(struct cr_context_t* ctx, struct cr_atlas_page_t* page) {
+  // The page was never counted, so no command references it yet.
+  if(page->view) ctx->vk.DestroyImageView(ctx->logical_dev, page->view, ctx->host.vk_alloc);
+  if(page->image) ctx->vk.DestroyImage(ctx->logical_dev, page->image, ctx->host.vk_alloc);
+  cr_memory_free(ctx, page->mem, page->mem_size, page->mem_type);
+  cr_host_free(ctx, page->skyline);
+  cr_host_free(ctx, page->shadow);
+  memset(page, 0, sizeof *page);
+}
+
+void
+_skyline_reset(struct cr_atlas_page_t* page, uint32_t size) {
+  page->skyline[0] = (struct cr_atlas_skyline_t){ .x = 0, .y = 0, .w = size };
+  page->n_skyline = 1;
+}
+
+bool
+_skyline_fit(const struct cr_atlas_page_t* page, uint32_t idx, uint32_t w, uint32_t h, uint32_t size, uint32_t* o_y) {
+  const struct cr_atlas_skyline_t* sky = page->skyline;
+  if(sky[idx].x + w > size) return false;
+
+  // The rect rests on the highest segment it spans.
+  uint32_t y = 0;
+  uint32_t remaining = w;
+  for(uint32_t i = idx; remaining > 0; i++) {
+    if(sky[i].y > y) y = sky[i].y;
+    if(y + h > size) return false;
+    remaining -= remaining < sky[i].w ? remaining : sky[i].w;
+  }
+  *o_y = y;
+  return true;
+}
+
+bool
+_skyline_pack(struct cr_atlas_page_t* page, uint32_t w, uint32_t h, uint32_t size, uint32_t* o_x, uint32_t* o_y) {
+  // Bottom-left: the position with the lowest top edge, ties broken by
+  // the narrower segment to keep wide gaps for wide rects.
+  uint32_t best = _EMPTY, best_top = UINT32_MAX, best_w = UINT32_MAX, best_y = 0;
+  for(uint32_t i = 0; i < page->n_skyline; i++) {
+    uint32_t y;
+    if(!_skyline_fit(page, i, w, h, size, &y)) continue;
+    if(y + h < best_top || (y + h == best_top && page->skyline[i].w < best_w)) {
+      best = i;
+      best_top = y + h;
+      best_w = page->skyline[i].w;
+      best_y = y;
+    }
+  }
+  if(best == _EMPTY) return false;
+
+  struct cr_atlas_skyline_t* sky = page->skyline;
+  const uint32_t x = sky[best].x;
+  memmove(&sky[best + 1], &sky[best], (page->n_skyline - best) * sizeof *sky);
+  sky[best] = (struct cr_atlas_skyline_t){ .x = x, .y = best_y + h, .w = w };
+  page->n_skyline++;
+
+  // Trim the segments now covered by the new one.
+  for(uint32_t i = best + 1; i < page->n_skyline;) {
+    const uint32_t end = sky[i - 1].x + sky[i - 1].w;
+    if(sky[i].x >= end) break;
+    const uint32_t shrink = end - sky[i].x;
+    if(sky[i].w > shrink) {
+      sky[i].x += shrink;
+      sky[i].w -= shrink;
+      break;
+    }
+    memmove(&sky[i], &sky[i + 1], (page->n_skyline - i - 1) * sizeof *sky);
+    page->n_skyline--;
+  }
+
+  // Merge neighbours at the same height.
+  for(uint32_t i = 0; i + 1 < page->n_skyline;) {
+    if(sky[i].y == sky[i + 1].y) {
+      sky[i].w += sky[i + 1].w;
+      memmove(&sky[i + 1], &sky[i + 2], (page->n_skyline - i - 2) * sizeof *sky);
+      page->n_skyline--;
+    } else {
+      i++;
+    }
+  }
+
+  *o_x = x;
+  *o_y = best_y;
+  return true;
+}
+
+bool
+_evict_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas, uint32_t* o_page) {
+  // Pages sampled by the frame being built must keep their contents; older
+  // frames are ordered before the upload by its barrier.
+  const uint64_t crnt_no = ctx->frameloop.frame_no + 1;
+  uint32_t victim = _EMPTY;
+  for(uint32_t p = 0; p < atlas->n_pages; p++) {
+    const struct cr_atlas_page_t* page = &atlas->pages[p];
+    if(page->last_use_no >= crnt_no) continue;
+    if(victim == _EMPTY || page->last_use_no < atlas->pages[victim].last_use_no) victim = p;
+  }
+  if(victim == _EMPTY) return false;
+
+  struct cr_atlas_page_t* page = &atlas->pages[victim];
+  for(uint32_t i = 0; i < atlas->n_slots; i++) {
+    struct cr_atlas_slot_t* slot = &atlas->slots[i];
+    if(!slot->live || slot->entry.page != victim) continue;
+    slot->live = false;
+    slot->next_free = atlas->free_slot;
+    atlas->free_slot = i;
+    atlas->n_live--;
+  }
+  if(!_table_rebuild(ctx, atlas, atlas->table_cap)) return false;
+
+  CR_TRACE(ctx->log, "Evicted atlas page %i (entries: %i, last used: %lu)",
+           victim, page->n_entries, (unsigned long)page->last_use_no);
+
+  _skyline_reset(page, atlas->page_size);
+  memset(page->shadow, 0, (size_t)atlas->page_size * atlas->page_size * atlas->bpp);
+  page->n_dirty = 0;
+  page->n_entries = 0;
+  atlas->n_evictions++;
+
+  *o_page = victim;
+  return true;
+}
+
+bool
+_add_dirty(struct cr_context_t* ctx, struct cr_atlas_page_t* page, VkRect2D rect) {
+  if(page->n_dirty == page->dirty_cap) {
+    const uint32_t cap = page->dirty_cap ? page->dirty_cap * 2 : 64;
+    VkRect2D* dirty = cr_host_realloc(ctx, page->dirty, cap * sizeof *dirty);
+    if(!dirty) return false;
+    page->dirty = dirty;
+    page->dirty_cap = cap;
+  }
+  page->dirty[page->n_dirty++] = rect;
+  return true;
+}
+
+bool
+cr_atlas_init(struct cr_context_t* ctx, struct cr_atlas_t* o_atlas, const struct cr_atlas_info_t* info) {
+  memset(o_atlas, 0, sizeof *o_atlas);
+  switch(info->fmt) {
+    case VK_FORMAT_R8_UNORM:
+      o_atlas->bpp = 1;
+      break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      o_atlas->bpp = 4;
+      break;
+    default:
+      CR_ERROR(ctx->log, "Unsupported atlas format %i", info->fmt);
+      return false;
+  }
+  o_atlas->fmt = info->fmt;
+  o_atlas->page_size = info->page_size ? info->page_size : _DEFAULT_PAGE_SIZE;
+  o_atlas->max_pages = info->max_pages && info->max_pages < CR_ATLAS_MAX_PAGES ?
+    info->max_pages : CR_ATLAS_MAX_PAGES;
+  o_atlas->free_slot = _EMPTY;
+
+  o_atlas->next = ctx->atlases;
+  ctx->atlases = o_atlas;
+
+  CR_TRACE(ctx->log, "Initialized atlas (format: %i, page size: %i, max pages: %i)",
+           o_atlas->fmt, o_atlas->page_size, o_atlas->max_pages);
+  return true;
+}
+
+bool
+cr_atlas_lookup(
+  struct cr_context_t* ctx,
+  struct cr_atlas_t* atlas,
+  uint64_t key,
+  struct cr_atlas_entry_t* o_entry) {
+  const uint32_t idx = _table_find(atlas, key);
+  if(idx == _EMPTY) return false;
+
+  struct cr_atlas_slot_t* slot = &atlas->slots[idx];
+  slot->last_use_no = ctx->frameloop.frame_no + 1;
+  atlas->pages[slot->entry.page].last_use_no = slot->last_use_no;
+  if(o_entry) *o_entry = slot->entry;
+  return true;
+}
+
+bool
+cr_atlas_insert(
+  struct cr_context_t* ctx,
+  struct cr_atlas_t* atlas,
+  uint64_t key,
+  uint32_t width,
+  uint32_t height,
+  const void* pixels,
+  uint32_t stride,
+  struct cr_atlas_entry_t* o_entry) {
+  if(cr_atlas_lookup(ctx, atlas, key, o_entry)) return true;
+
+  const uint32_t w = width + 2 * CR_ATLAS_PADDING;
+  const uint32_t h = height + 2 * CR_ATLAS_PADDING;
+  if(key == 0 || width == 0 || height == 0 || w > atlas->page_size || h > atlas->page_size) {
+    CR_ERROR(ctx->log, "Cannot insert %ix%i image into atlas (key: %lu, page size: %i)",
+             width, height, (unsigned long)key, atlas->page_size);
+    return false;
+  }
+
+  uint32_t page_idx = _EMPTY, x = 0, y = 0;
+  for(uint32_t p = 0; p < atlas->n_pages && page_idx == _EMPTY; p++) {
+    if(_skyline_pack(&atlas->pages[p], w, h, atlas->page_size, &x, &y)) page_idx = p;
+  }
+  if(page_idx == _EMPTY) {
+    if(atlas->n_pages < atlas->max_pages) {
+      if(!_create_page(ctx, atlas)) return false;
+      page_idx = atlas->n_pages - 1;
+    } else if(!_evict_page(ctx, atlas, &page_idx)) {
+      CR_WARN(ctx->log, "Atlas is full and every page is used by the current frame (pages: %i)", atlas->n_pages);
+      return false;
+    }
+    if(!_skyline_pack(&atlas->pages[page_idx], w, h, atlas->page_size, &x, &y)) return false;
+  }
+
+  if(atlas->n_slots == atlas->slot_cap && atlas->free_slot == _EMPTY) {
+    const uint32_t cap = atlas->slot_cap ? atlas->slot_cap * 2 : 256;
+    struct cr_atlas_slot_t* slots = cr_host_realloc(ctx, atlas->slots, cap * sizeof *slots);
+    if(!slots) return false;
+    atlas->slots = slots;
+    atlas->slot_cap = cap;
+  }
+  if((atlas->n_live + 1) * 2 > atlas->table_cap &&
+     !_table_rebuild(ctx, atlas, atlas->table_cap ? atlas->table_cap * 2 : 512)) {
+    return false;
+  }
+
+  struct cr_atlas_page_t* page = &atlas->pages[page_idx];
+  const VkRect2D rect = {
+    .offset = { (int32_t)(x + CR_ATLAS_PADDING), (int32_t)(y + CR_ATLAS_PADDING) },
+    .extent = { width, height }
+  };
+  const size_t row_size = (size_t)width * atlas->bpp;
+  for(uint32_t row = 0; row < height; row++) {
+    memcpy(page->shadow + ((size_t)(rect.offset.y + row) * atlas->page_size + rect.offset.x) * atlas->bpp,
+           (const uint8_t*)pixels + (size_t)row * stride, row_size);
+  }
+  // The padding is uploaded too, as it may hold pixels of an evicted entry.
+  if(!_add_dirty(ctx, page, (VkRect2D){ .offset = { (int32_t)x, (int32_t)y }, .extent = { w, h } })) return false;
+
+  uint32_t idx;
+  if(atlas->free_slot != _EMPTY) {
+    idx = atlas->free_slot;
+    atlas->free_slot = atlas->slots[idx].next_free;
+  } else {
+    idx = atlas->n_slots++;
+  }
+  const float size = (float)atlas->page_size;
+  atlas->slots[idx] = (struct cr_atlas_slot_t){
+    .key = key,
+    .entry = {
+      .page = page_idx,
+      .rect = rect,
+      .uv = {
+        rect.offset.x / size, rect.offset.y / size,
+        (rect.offset.x + width) / size, (rect.offset.y + height) / size
+      }
+    },
+    .last_use_no = ctx->frameloop.frame_no + 1,
+    .next_free = _EMPTY,
+    .live = true
+  };
+  atlas->n_live++;
+  page->n_entries++;
+  page->last_use_no = ctx->frameloop.frame_no + 1;
+
+  uint32_t t = _hash(key, atlas->table_cap);
+  while(atlas->table[t] != _EMPTY) t = (t + 1) & (atlas->table_cap - 1);
+  atlas->table[t] = idx;
+
+  if(o_entry) *o_entry = atlas->slots[idx].entry;
+  return true;
+}
+
+bool
+_record_page(struct cr_context_t* ctx, struct cr_atlas_t* atlas, struct cr_atlas_page_t* page, VkCommandBuffer cmd) {
+  VkBufferImageCopy* regions = cr_frame_scratch_alloc(ctx, page->n_dirty * sizeof *regions, sizeof(VkDeviceSize));
+  if(!regions) return false;
+
+  // Every region comes from the frame's single upload buffer.
+  VkBuffer src = VK_NULL_HANDLE;
+  uint32_t n_regions = 0;
+  for(; n_regions < page->n_dirty; n_regions++) {
+    const VkRect2D* rect = &page->dirty[n_regions];
+    const size_t row_size = (size_t)rect->extent.width * atlas->bpp;
+    VkDeviceSize offset;
+    uint8_t* dst = cr_frame_upload_alloc(ctx, row_size * rect->extent.height, 4, &src, &offset);
+    if(!dst) break;
+
+    for(uint32_t row = 0; row < rect->extent.height; row++) {
+      memcpy(dst + row * row_size,
+             page->shadow + ((size_t)(rect->offset.y + row) * atlas->page_size + rect->offset.x) * atlas->bpp,
+             row_size);
+    }
+    regions[n_regions] = (VkBufferImageCopy){
+      .bufferOffset = offset,
+      .imageSubresource = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .layerCount = 1
+      },
+      .imageOffset = { rect->offset.x, rect->offset.y, 0 },
+      .imageExtent = { rect->extent.width, rect->extent.height, 1 }
+    };
+    atlas->n_uploaded_bytes += row_size * rect->extent.height;
+  }
+  if(n_regions == 0) return true;
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = 0,
+    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .oldLayout = page->initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = page->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = 1,
+      .layerCount = 1
+    }
+  };
+  ctx->vk.CmdPipelineBarrier(cmd,
+                             page->initialized ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+  ctx->vk.CmdCopyBufferToImage(cmd, src, page->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n_regions, regions);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  ctx->vk.CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, NULL, 0, NULL, 1, &barrier);
+  page->initialized = true;
+
+  // Rects that did not fit into the upload memory go next frame.
+  memmove(page->dirty, page->dirty + n_regions, (page->n_dirty - n_regions) * sizeof *page->dirty);
+  page->n_dirty -= n_regions;
+  return true;
+}
+
+bool
+cr_atlas_record_uploads(struct cr_context_t* ctx, VkCommandBuffer cmd) {
+  for(struct cr_atlas_t* atlas = ctx->atlases; atlas; atlas = atlas->next) {
+    for(uint32_t p = 0; p < atlas->n_pages; p++) {
+      struct cr_atlas_page_t* page = &atlas->pages[p];
+      if(page->n_dirty > 0 && !_record_page(ctx, atlas, page, cmd)) return false;
+    }
+  }
+  return true;
+}
+
+void
+cr_atlas_destroy(struct cr_context_t* ctx, struct cr_atlas_t* atlas) {
+  for(struct cr_atlas_t** it = &ctx->atlases; *it; it = &(*it)->next) {
+    if(*it == atlas) {
+      *it = atlas->next;
+      break;
+    }
+  }
+
+  for(uint32_t p = 0; p < atlas->n_pages; p++) {
+    struct cr_atlas_page_t* page = &atlas->pages[p];
+    if(page->view) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE_VIEW, (union cr_deletion_handle_t){ .image_view = page->view });
+    }
+    if(page->image) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE, (union cr_deletion_handle_t){ .image = page->image });
+    }
+    if(page->mem) {
+      union cr_deletion_handle_t h = { .memory = { page->mem, page->mem_size, page->mem_type } };
+      cr_deletion_push(ctx, CR_DELETION_MEMORY, h);
+    }
+    cr_host_free(ctx, page->skyline);
+    cr_host_free(ctx, page->shadow);
+    cr_host_free(ctx, page->dirty);
+  }
+  cr_host_free(ctx, atlas->slots);
+  cr_host_free(ctx, atlas->table);
+  memset(atlas, 0, sizeof *atlas);
+}
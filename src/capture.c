@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+#include "../include/corender/capture.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/draw.h"
+#include "../include/corender/util.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define _SUBSYS_NAME "CAPTURE"
+
+#define _CAPTURE_INITIAL_SIZE (16u << 20)
+
+static bool _grow(struct cr_capture_t* cap, size_t needed);
+
+bool
+_grow(struct cr_capture_t* cap, size_t needed) {
+  size_t size = cap->map_size;
+  while(size < needed) size *= 2;
+
+  if(ftruncate(cap->fd, (off_t)size) != 0) return false;
+
+  void* map = mremap(cap->map, cap->map_size, size, MREMAP_MAYMOVE);
+  if(map == MAP_FAILED) return false;
+
+  cap->map = map;
+  cap->map_size = size;
+  return true;
+}
+
+bool
+cr_capture_open(struct cr_capture_t* o_cap, const char* path) {
+  memset(o_cap, 0, sizeof *o_cap);
+  o_cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(o_cap->fd < 0) return false;
+
+  if(ftruncate(o_cap->fd, _CAPTURE_INITIAL_SIZE) != 0) {
+    close(o_cap->fd);
+    return false;
+  }
+
+  o_cap->map = mmap(NULL, _CAPTURE_INITIAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, o_cap->fd, 0);
+  if(o_cap->map == MAP_FAILED) {
+    close(o_cap->fd);
+    return false;
+  }
+  o_cap->map_size = _CAPTURE_INITIAL_SIZE;
+
+  struct cr_capture_header_t header = { .version = CR_CAPTURE_VERSION };
+  memcpy(header.magic, CR_CAPTURE_MAGIC, sizeof header.magic);
+  memcpy(o_cap->map, &header, sizeof header);
+  o_cap->offset = sizeof header;
+
+  return true;
+}
+
+void
+cr_capture_close(struct cr_capture_t* cap) {
+  if(!cap->map) return;
+
+  munmap(cap->map, cap->map_size);
+  // Trim the preallocated tail so the file ends at the last record.
+  if(ftruncate(cap->fd, (off_t)cap->offset) != 0) {
+    cap->failed = true;
+  }
+  close(cap->fd);
+  cap->map = NULL;
+  cap->fd = -1;
+}
+
+void*
+cr_capture_record(struct cr_capture_t* cap, enum cr_capture_record_type_t type, uint32_t size) {
+  if(!cap || !cap->map || cap->failed) return NULL;
+
+  const size_t total = sizeof(struct cr_capture_record_t) + (((size_t)size + 7) & ~(size_t)7);
+  if(cap->offset + total > cap->map_size && !_grow(cap, cap->offset + total)) {
+    cap->failed = true;
+    return NULL;
+  }
+
+  struct cr_capture_record_t* record = (struct cr_capture_record_t*)(cap->map + cap->offset);
+  record->type = type;
+  record->size = size;
+  cap->offset += total;
+  return record + 1;
+}
+
+void
+cr_capture_frame(struct cr_context_t* ctx) {
+  struct cr_capture_t* cap = ctx->capture;
+  if(!cap || !cap->map) return;
+
+  const struct cr_frame_t* frame = &ctx->frameloop.frames[ctx->frameloop.frame_idx];
+  if(frame->upload_offset > 0) {
+    // Reads back from the mapped upload memory, which may be write-combined;
+    // slow, but capture is a diagnostic mode.
+    void* dst = cr_capture_record(cap, CR_CAPTURE_RECORD_UPLOAD, (uint32_t)frame->upload_offset);
+    if(dst) memcpy(dst, frame->upload.mapped, frame->upload_offset);
+  }
+
+  const uint64_t now = cr_util_time_ns();
+  struct cr_capture_frame_t* rec = cr_capture_record(cap, CR_CAPTURE_RECORD_FRAME, sizeof *rec);
+  if(rec) {
+    *rec = (struct cr_capture_frame_t){
+      .frame_ns = cap->last_frame_ns ? now - cap->last_frame_ns : 0,
+      .draw_list = ctx->outputs[0].draw_list ? ctx->outputs[0].draw_list->capture_id : 0
+    };
+  }
+  cap->last_frame_ns = now;
+
+  if(cap->failed) {
+    CR_ERROR(ctx->log, "Capture stream failed, disabling capture.");
+    cr_capture_close(cap);
+  }
+}
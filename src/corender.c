@@ -1,22 +1,16 @@
 #include "../include/corender/corender.h"
+#include "../include/corender/capture.h"
+#include "../include/corender/draw.h"
+#include "../include/corender/text.h"
 #include "../include/corender/util.h"
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <vulkan/vulkan_core.h>
 
 
 #define _SUBSYS_NAME "CORE"
 
-#define _VK_CHECK(ctx, expr)                              \
-do {                                                      \
-  VkResult _res = (expr);                                 \
-  if (_res != VK_SUCCESS) {                               \
-    CR_ERROR(ctx->log, "Vulkan error: %s (%i) - %s failed.", \
-    _vk_result_to_string(_res), _res, #expr);              \
-    return false;                                         \
-  }                                                       \
-} while (0)
-
 struct cr_swapchain_info_t {
   VkPresentModeKHR present_modes[16];
   uint32_t n_present_modes;
@@ -25,16 +19,54 @@ struct cr_swapchain_info_t {
   VkSurfaceCapabilitiesKHR caps;
 };
 
+// Init work that only needs the logical device and render pass, run on a
+// worker thread while the main thread sets up the swapchain and frameloop.
+struct cr_init_worker_t {
+  pthread_t thread;
+  bool threaded;
+
+  struct cr_context_t* ctx;
+  const struct cr_context_init_info_t* info;
+
+  bool result;
+  uint64_t ns;
+};
+
 static bool     _create_log_context(struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
 static bool     _create_rendering_context(struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
 static VkResult _create_instance(struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
 static VkResult _create_logical_device(struct cr_context_t* ctx);
-static bool     _create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain, uint32_t w, uint32_t h);
+static bool     _create_swapchain(
+  struct cr_context_t* ctx, struct cr_swapchain_t* o_swapchain, VkSurfaceKHR surf, uint32_t w, uint32_t h);
+static bool     _reserve_swapchain_arrays(struct cr_context_t* ctx, struct cr_swapchain_t* swapchain, bool offscreen);
+static bool     _create_offscreen_swapchain(
+  struct cr_context_t* ctx, struct cr_swapchain_t* o_swapchain, uint32_t w, uint32_t h);
+static bool     _create_output(struct cr_context_t* ctx, struct cr_output_t* out);
+static bool     _create_output_images(struct cr_context_t* ctx, struct cr_output_t* out);
+static void     _retire_output_images(struct cr_context_t* ctx, struct cr_output_t* out);
+static bool     _recreate_output(struct cr_context_t* ctx, struct cr_output_t* out);
+static void     _destroy_output(struct cr_context_t* ctx, struct cr_output_t* out);
+static void     _destroy_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* frameloop);
 static bool     _create_frameloop(
   struct 
   cr_context_t* ctx, struct cr_frameloop_t* o_frameloop, uint32_t graphics_queue_family); 
 
+static bool     _create_render_pass(
+  struct cr_context_t* ctx, VkFormat fmt, VkImageLayout final_layout, VkRenderPass* o_pass);
+static bool     _create_capture(struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
+
+static void*    _init_worker_run(void* data);
+static void     _init_worker_start(
+  struct cr_init_worker_t* worker, struct cr_context_t* ctx, const struct cr_context_init_info_t* info);
+static bool     _init_worker_join(struct cr_init_worker_t* worker);
+static void     _log_stage(struct cr_context_t* ctx, const char* stage, uint64_t* stage_start);
+static bool     _pick_surface_format(struct cr_context_t* ctx, VkSurfaceKHR surf, VkSurfaceFormatKHR* o_fmt);
+static bool     _acquire_output(struct cr_context_t* ctx, struct cr_output_t* out, uint32_t frame_idx);
+static bool     _record_output(
+  struct cr_context_t* ctx, struct cr_output_t* out, VkCommandBuffer cmd, uint32_t frame_idx);
+
 static bool _pick_physical_device(struct cr_context_t* ctx);
+static bool _device_supports_extension(struct cr_context_t* ctx, VkPhysicalDevice dev, const char* name);
 static bool _get_swapchain_info_from_physical_device(
   struct cr_context_t* ctx,
   VkPhysicalDevice dev, 
@@ -47,7 +79,6 @@ static VkPresentModeKHR   _get_swapchain_present_mode(const struct cr_swapchain_
 static VkExtent2D         _get_swapchain_extent(
   const struct cr_swapchain_info_t* swapchain, uint32_t w, uint32_t h);
 
-static const char* _vk_result_to_string(VkResult r);
 
 
 
@@ -77,23 +108,110 @@ _create_log_context(struct cr_context_t* ctx, const struct cr_context_init_info_
   return true;
 }
 
-  bool 
+void
+_log_stage(struct cr_context_t* ctx, const char* stage, uint64_t* stage_start) {
+  const uint64_t now = cr_util_time_ns();
+  CR_TRACE(ctx->log, "Init stage '%s' took %.3f ms", stage, (now - *stage_start) / 1e6);
+  *stage_start = now;
+}
+
+void*
+_init_worker_run(void* data) {
+  struct cr_init_worker_t* worker = data;
+  struct cr_context_t* ctx = worker->ctx;
+  const uint64_t start = cr_util_time_ns();
+
+  // Contexts that build no pipelines at init leave the cache file alone;
+  // their pipeline_cache.handle stays VK_NULL_HANDLE.
+  worker->result = true;
+  if(worker->info->pipelines_create || worker->info->pipeline_cache_path) {
+    worker->result = cr_pipeline_cache_load(ctx, &ctx->pipeline_cache, worker->info->pipeline_cache_path);
+  }
+  if(worker->result && worker->info->pipelines_create) {
+    worker->result = worker->info->pipelines_create(
+      ctx, ctx->pipeline_cache.handle, ctx->frameloop.crnt_pass, worker->info->pipelines_userdata);
+    if(!worker->result) {
+      CR_ERROR(ctx->log, "Application pipeline creation failed.");
+    }
+  }
+
+  worker->ns = cr_util_time_ns() - start;
+  return NULL;
+}
+
+void
+_init_worker_start(
+  struct cr_init_worker_t* worker, struct cr_context_t* ctx, const struct cr_context_init_info_t* info) {
+  worker->ctx = ctx;
+  worker->info = info;
+  worker->threaded = pthread_create(&worker->thread, NULL, _init_worker_run, worker) == 0;
+  if(!worker->threaded) {
+    CR_WARN(ctx->log, "Failed to spawn init worker, loading pipelines serially.");
+    _init_worker_run(worker);
+  }
+}
+
+bool
+_init_worker_join(struct cr_init_worker_t* worker) {
+  if(worker->threaded) {
+    pthread_join(worker->thread, NULL);
+    worker->threaded = false;
+  }
+  CR_TRACE(worker->ctx->log, "Init stage 'pipelines' took %.3f ms (worker thread)", worker->ns / 1e6);
+  return worker->result;
+}
+
+bool
+_pick_surface_format(struct cr_context_t* ctx, VkSurfaceKHR surf, VkSurfaceFormatKHR* o_fmt) {
+  if(!surf) {
+    *o_fmt = (VkSurfaceFormatKHR){
+      .format = VK_FORMAT_B8G8R8A8_UNORM,
+      .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
+    };
+    return true;
+  }
+
+  struct cr_swapchain_info_t info;
+  if(!_get_swapchain_info_from_physical_device(ctx, ctx->phys_dev, surf, &info)) {
+    return false;
+  }
+  *o_fmt = _get_swapchain_surface_format(&info);
+  return true;
+}
+
+bool 
 _create_rendering_context(struct cr_context_t* ctx, const struct cr_context_init_info_t* info) {
+  const uint64_t init_start = cr_util_time_ns();
+  uint64_t stage_start = init_start;
+
+  if(!cr_dispatch_load(ctx, info->get_instance_proc_addr)) {
+    CR_ERROR(ctx->log, "Failed to load Vulkan.");
+    return false;
+  }
+
   VkResult instance_res = _create_instance(ctx, info); 
   if(instance_res != VK_SUCCESS) {
     CR_ERROR(ctx->log, "Failed to create Vulkan instance: (error code: %i)", instance_res);
     return false;
   } 
+  if(!cr_dispatch_load_instance(ctx)) {
+    CR_ERROR(ctx->log, "Failed to load Vulkan instance functions.");
+    return false;
+  }
+  _log_stage(ctx, "instance", &stage_start);
 
   if(!info->surface_create) {
     CR_FATAL(ctx->log, "info->surface_create is NULL, you need to provide a surface creation function.") ;
     return false;
   }
 
-  if(!info->surface_create(ctx->instance, &ctx->surf, info->surface_userdata)) {
+  struct cr_output_t* primary = &ctx->outputs[0];
+  if(!info->surface_create(ctx->instance, &primary->surf, info->surface_userdata)) {
     CR_ERROR(ctx->log, "Failed to create platform surface.");
     return false;
   }
+  ctx->n_outputs = 1;
+  _log_stage(ctx, "surface", &stage_start);
 
   if(!_pick_physical_device(ctx)) {
     CR_ERROR(ctx->log, "Failed to pick Vulkan physical device.");
@@ -105,22 +223,52 @@ _create_rendering_context(struct cr_context_t* ctx, const struct cr_context_init
     return false;
   }
 
-  if(ctx->surf.surf) {
-    if(!_create_swapchain(ctx, &ctx->swapchain, ctx->surf.width, ctx->surf.height)) {
-      CR_ERROR(ctx->log, "Failed to create Vulkan swap chain (width: %i, height: %i)", 
-               ctx->surf.width, ctx->surf.height);
-      return false;
-    }
+  if(!cr_memory_init(ctx, &info->memory_pressure)) {
+    CR_ERROR(ctx->log, "Failed to initialize memory tracking.");
+    return false;
+  }
+  _log_stage(ctx, "device", &stage_start);
+
+  // The render pass only depends on the surface format, so it is created
+  // up front and pipelines can be built against it while the swapchain
+  // and frameloop are set up.
+  VkSurfaceFormatKHR fmt;
+  if(!_pick_surface_format(ctx, primary->surf.surf, &fmt)) {
+    CR_ERROR(ctx->log, "Failed to query surface formats.");
+    return false;
+  }
+  const VkImageLayout final_layout = primary->surf.surf ?
+    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  if(!_create_render_pass(ctx, fmt.format, final_layout, &ctx->frameloop.crnt_pass)) {
+    CR_ERROR(ctx->log, "Failed to create Vulkan render pass.");
+    return false;
+  }
+  _log_stage(ctx, "render pass", &stage_start);
+
+  struct cr_init_worker_t worker = {0};
+  _init_worker_start(&worker, ctx, info);
 
-    ctx->frameloop.swapchain = ctx->swapchain;
+  bool ok = _create_output(ctx, primary);
+  if(ok) _log_stage(ctx, "output", &stage_start);
 
+  if(ok) {
     if(!_create_frameloop(ctx, &ctx->frameloop, ctx->graphics_queue_family)) {
-      CR_ERROR(ctx->log, "Failed to create Vulkan frame loop (width: %i, height: %i)", 
-               ctx->surf.width, ctx->surf.height);
-      return false;
+      CR_ERROR(ctx->log, "Failed to create Vulkan frame loop.");
+      ok = false;
+    } else {
+      _log_stage(ctx, "frameloop", &stage_start);
     }
   }
 
+  // Always joined, the worker references `ctx` and `info`.
+  if(!_init_worker_join(&worker)) {
+    CR_ERROR(ctx->log, "Failed to load pipelines.");
+    ok = false;
+  }
+  if(!ok) return false;
+
+  CR_TRACE(ctx->log, "Initialized rendering context in %.3f ms", (cr_util_time_ns() - init_start) / 1e6);
+
   return true;
 }
 
@@ -144,7 +292,7 @@ _create_instance(struct cr_context_t* ctx, const struct cr_context_init_info_t*
     .ppEnabledLayerNames = info->enable_validation ? info->layers : NULL
   };
 
-  VkResult res = vkCreateInstance(&create_info, NULL, &ctx->instance); 
+  VkResult res = ctx->vk.CreateInstance(&create_info, ctx->host.vk_alloc, &ctx->instance); 
   if(res == VK_SUCCESS) {
     CR_TRACE(ctx->log, "Initialized Vulkan instance: (version: 1.3, enabledExtensionCount: %i, enabledLayerCount: %i)",
              create_info.enabledExtensionCount, create_info.enabledLayerCount);
@@ -156,20 +304,20 @@ _create_instance(struct cr_context_t* ctx, const struct cr_context_init_info_t*
 
 bool _pick_physical_device(struct cr_context_t* ctx) {
   uint32_t count = 0;
-  vkEnumeratePhysicalDevices(ctx->instance, &count, NULL);
+  ctx->vk.EnumeratePhysicalDevices(ctx->instance, &count, NULL);
   if (count == 0) return false;
 
   VkPhysicalDevice devices[16];
-  vkEnumeratePhysicalDevices(ctx->instance, &count, devices);
+  ctx->vk.EnumeratePhysicalDevices(ctx->instance, &count, devices);
 
   for (uint32_t i = 0; i < count; i++) {
     VkPhysicalDevice dev = devices[i];
 
     uint32_t qcount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(dev, &qcount, NULL);
+    ctx->vk.GetPhysicalDeviceQueueFamilyProperties(dev, &qcount, NULL);
 
     VkQueueFamilyProperties qprops[16];
-    vkGetPhysicalDeviceQueueFamilyProperties(dev, &qcount, qprops);
+    ctx->vk.GetPhysicalDeviceQueueFamilyProperties(dev, &qcount, qprops);
 
     int graphics = -1;
     int present  = -1;
@@ -178,9 +326,9 @@ bool _pick_physical_device(struct cr_context_t* ctx) {
       if (qprops[q].queueFlags & VK_QUEUE_GRAPHICS_BIT)
         graphics = q;
 
-      if (ctx->surf.surf) {
+      if (ctx->outputs[0].surf.surf) {
         VkBool32 supported = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(dev, q, ctx->surf.surf, &supported);
+        ctx->vk.GetPhysicalDeviceSurfaceSupportKHR(dev, q, ctx->outputs[0].surf.surf, &supported);
         if (supported)
           present = q;
       } else {
@@ -194,7 +342,8 @@ bool _pick_physical_device(struct cr_context_t* ctx) {
       ctx->present_queue_family  = present;
 
       VkPhysicalDeviceProperties props;
-      vkGetPhysicalDeviceProperties(dev, &props);
+      ctx->vk.GetPhysicalDeviceProperties(dev, &props);
+      ctx->vk.GetPhysicalDeviceMemoryProperties(dev, &ctx->mem_props);
       CR_TRACE(
         ctx->log, 
         "Picked physical device: (name: %s, API version: %i, driver version: %i, present queue: %i, graphics queue: %i)",
@@ -211,6 +360,22 @@ bool _pick_physical_device(struct cr_context_t* ctx) {
   return false;
 }
 
+bool
+_device_supports_extension(struct cr_context_t* ctx, VkPhysicalDevice dev, const char* name) {
+  uint32_t count = 0;
+  ctx->vk.EnumerateDeviceExtensionProperties(dev, NULL, &count, NULL);
+
+  VkExtensionProperties* exts = cr_frame_scratch_alloc(ctx, count * sizeof *exts, sizeof(void*));
+  if(!exts) return false;
+  ctx->vk.EnumerateDeviceExtensionProperties(dev, NULL, &count, exts);
+
+  bool found = false;
+  for(uint32_t i = 0; i < count && !found; i++) {
+    found = strcmp(exts[i].extensionName, name) == 0;
+  }
+  return found;
+}
+
 VkResult
 _create_logical_device(struct cr_context_t* ctx) {
   const float priority = 1.0f;
@@ -233,26 +398,94 @@ _create_logical_device(struct cr_context_t* ctx) {
     };
   }
 
-  const char* device_exts[] = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+  const char* device_exts[3];
+  uint32_t n_device_exts = 0;
+  if(ctx->outputs[0].surf.surf) {
+    device_exts[n_device_exts++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+  }
+  ctx->features.memory_budget = _device_supports_extension(ctx, ctx->phys_dev, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if(ctx->features.memory_budget) {
+    device_exts[n_device_exts++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
+
+  VkPhysicalDeviceProperties props;
+  ctx->vk.GetPhysicalDeviceProperties(ctx->phys_dev, &props);
+
+  // Lets client shared memory be imported instead of copied (see shm.h).
+  if(_device_supports_extension(ctx, ctx->phys_dev, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT
+    };
+    VkPhysicalDeviceProperties2 props2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+      .pNext = &host_props
+    };
+    ctx->vk.GetPhysicalDeviceProperties2(ctx->phys_dev, &props2);
+
+    ctx->features.external_memory_host = true;
+    ctx->features.host_pointer_alignment = host_props.minImportedHostPointerAlignment;
+    device_exts[n_device_exts++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+  }
+
+  // Indirect draw features used by the draw list, enabled when available.
+  VkPhysicalDeviceVulkan12Features features12 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+  };
+  VkPhysicalDeviceFeatures2 features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = props.apiVersion >= VK_API_VERSION_1_2 ? &features12 : NULL
+  };
+  ctx->vk.GetPhysicalDeviceFeatures2(ctx->phys_dev, &features);
+
+  ctx->features.draw_indirect_count = features12.drawIndirectCount == VK_TRUE;
+  ctx->features.multi_draw_indirect = features.features.multiDrawIndirect == VK_TRUE;
+  ctx->features.draw_indirect_first_instance = features.features.drawIndirectFirstInstance == VK_TRUE;
+  ctx->features.texture_compression_bc = features.features.textureCompressionBC == VK_TRUE;
+
+  VkPhysicalDeviceVulkan12Features enabled12 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .drawIndirectCount = features12.drawIndirectCount
+  };
+  VkPhysicalDeviceFeatures2 enabled = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = features.pNext ? &enabled12 : NULL,
+    .features = {
+      .multiDrawIndirect = features.features.multiDrawIndirect,
+      // Draw lists offset firstInstance into their per-frame object copies.
+      .drawIndirectFirstInstance = features.features.drawIndirectFirstInstance,
+      .textureCompressionBC = features.features.textureCompressionBC
+    }
   };
 
   VkDeviceCreateInfo device_info = {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .pNext = &enabled,
     .pQueueCreateInfos = queues,
     .queueCreateInfoCount = queue_count, 
-    .enabledExtensionCount = ctx->surf.surf ? 1 : 0, 
-    .ppEnabledExtensionNames = ctx->surf.surf ? device_exts : NULL
+    .enabledExtensionCount = n_device_exts, 
+    .ppEnabledExtensionNames = n_device_exts ? device_exts : NULL
   };
 
-  VkResult res = vkCreateDevice(ctx->phys_dev, &device_info, NULL, &ctx->logical_dev);
+  VkResult res = ctx->vk.CreateDevice(ctx->phys_dev, &device_info, ctx->host.vk_alloc, &ctx->logical_dev);
   if(res == VK_SUCCESS) {
-    CR_TRACE(ctx->log, "Initialized Vulkan logical device (graphics queue index: %i, present queue index; %i)",
-             ctx->graphics_queue_family, ctx->present_queue_family);
+    CR_TRACE(ctx->log, "Initialized Vulkan logical device (graphics queue index: %i, present queue index; %i, "
+             "draw indirect count: %s, multi draw indirect: %s, draw indirect first instance: %s, memory budget: %s, external memory host: %s, "
+             "bc textures: %s)",
+             ctx->graphics_queue_family, ctx->present_queue_family,
+             ctx->features.draw_indirect_count ? "true" : "false",
+             ctx->features.multi_draw_indirect ? "true" : "false",
+             ctx->features.draw_indirect_first_instance ? "true" : "false",
+             ctx->features.memory_budget ? "true" : "false",
+             ctx->features.external_memory_host ? "true" : "false",
+             ctx->features.texture_compression_bc ? "true" : "false");
   }
+  if(res != VK_SUCCESS) return res;
+
+  // Everything past this point calls the device's own entry points.
+  if(!cr_dispatch_load_device(ctx)) return VK_ERROR_INITIALIZATION_FAILED;
 
-  vkGetDeviceQueue(ctx->logical_dev, ctx->graphics_queue_family, 0, &ctx->graphics_queue);
-  vkGetDeviceQueue(ctx->logical_dev, ctx->present_queue_family, 0, &ctx->present_queue);
+  ctx->vk.GetDeviceQueue(ctx->logical_dev, ctx->graphics_queue_family, 0, &ctx->graphics_queue);
+  ctx->vk.GetDeviceQueue(ctx->logical_dev, ctx->present_queue_family, 0, &ctx->present_queue);
 
   return res;
 }
@@ -265,11 +498,11 @@ _get_swapchain_info_from_physical_device(
   VkSurfaceKHR surf,
 struct cr_swapchain_info_t* o_info 
 ) {
-  _VK_CHECK(ctx, vkGetPhysicalDeviceSurfaceCapabilitiesKHR(dev, surf, &o_info->caps));
-  _VK_CHECK(ctx, vkGetPhysicalDeviceSurfaceFormatsKHR(dev, surf, &o_info->n_fmts, NULL));
-  _VK_CHECK(ctx, vkGetPhysicalDeviceSurfaceFormatsKHR(dev, surf, &o_info->n_fmts, o_info->fmts));
-  _VK_CHECK(ctx, vkGetPhysicalDeviceSurfacePresentModesKHR(dev, surf, &o_info->n_present_modes, NULL));
-  _VK_CHECK(ctx, vkGetPhysicalDeviceSurfacePresentModesKHR(
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfaceCapabilitiesKHR(dev, surf, &o_info->caps));
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfaceFormatsKHR(dev, surf, &o_info->n_fmts, NULL));
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfaceFormatsKHR(dev, surf, &o_info->n_fmts, o_info->fmts));
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfacePresentModesKHR(dev, surf, &o_info->n_present_modes, NULL));
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfacePresentModesKHR(
     dev, surf, &o_info->n_present_modes, o_info->present_modes));
 
   return true;
@@ -312,41 +545,11 @@ _get_swapchain_extent(const struct cr_swapchain_info_t* swapchain, uint32_t w, u
 }
 
 
-const char* _vk_result_to_string(VkResult r)
-{
-    switch (r) {
-        case VK_SUCCESS: return "VK_SUCCESS";
-        case VK_NOT_READY: return "VK_NOT_READY";
-        case VK_TIMEOUT: return "VK_TIMEOUT";
-        case VK_EVENT_SET: return "VK_EVENT_SET";
-        case VK_EVENT_RESET: return "VK_EVENT_RESET";
-        case VK_INCOMPLETE: return "VK_INCOMPLETE";
-
-        case VK_ERROR_OUT_OF_HOST_MEMORY: return "VK_ERROR_OUT_OF_HOST_MEMORY";
-        case VK_ERROR_OUT_OF_DEVICE_MEMORY: return "VK_ERROR_OUT_OF_DEVICE_MEMORY";
-        case VK_ERROR_INITIALIZATION_FAILED: return "VK_ERROR_INITIALIZATION_FAILED";
-        case VK_ERROR_DEVICE_LOST: return "VK_ERROR_DEVICE_LOST";
-        case VK_ERROR_MEMORY_MAP_FAILED: return "VK_ERROR_MEMORY_MAP_FAILED";
-        case VK_ERROR_LAYER_NOT_PRESENT: return "VK_ERROR_LAYER_NOT_PRESENT";
-        case VK_ERROR_EXTENSION_NOT_PRESENT: return "VK_ERROR_EXTENSION_NOT_PRESENT";
-        case VK_ERROR_FEATURE_NOT_PRESENT: return "VK_ERROR_FEATURE_NOT_PRESENT";
-        case VK_ERROR_INCOMPATIBLE_DRIVER: return "VK_ERROR_INCOMPATIBLE_DRIVER";
-        case VK_ERROR_TOO_MANY_OBJECTS: return "VK_ERROR_TOO_MANY_OBJECTS";
-        case VK_ERROR_FORMAT_NOT_SUPPORTED: return "VK_ERROR_FORMAT_NOT_SUPPORTED";
-        case VK_ERROR_FRAGMENTED_POOL: return "VK_ERROR_FRAGMENTED_POOL";
-
-        case VK_ERROR_OUT_OF_DATE_KHR: return "VK_ERROR_OUT_OF_DATE_KHR";
-        case VK_SUBOPTIMAL_KHR: return "VK_SUBOPTIMAL_KHR";
-
-        default: return "VK_ERROR_UNKNOWN";
-    }
-}
-
-
 bool 
-_create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain, uint32_t w, uint32_t h) {
+_create_swapchain(
+  struct cr_context_t* ctx, struct cr_swapchain_t* o_swapchain, VkSurfaceKHR surf, uint32_t w, uint32_t h) {
   struct cr_swapchain_info_t info;
-  if(!_get_swapchain_info_from_physical_device(ctx, ctx->phys_dev, ctx->surf.surf, &info)) {
+  if(!_get_swapchain_info_from_physical_device(ctx, ctx->phys_dev, surf, &info)) {
     CR_ERROR(ctx->log, "Failed to get swapchain info from physical device.");
     return false;
   }
@@ -360,19 +563,25 @@ _create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain,
     n_imgs = info.caps.maxImageCount;
   }
 
+  // Transfer source enables readback of presented images.
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+    (info.caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
   VkSwapchainCreateInfoKHR create_info = {
     .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR, 
-    .surface = ctx->surf.surf,
+    .surface = surf,
     .minImageCount = n_imgs,
     .imageFormat = fmt.format, 
     .imageColorSpace = fmt.colorSpace,
     .imageExtent = extent,
     .imageArrayLayers = 1,
-    .imageUsage   = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+    .imageUsage   = usage,
     .preTransform = info.caps.currentTransform,
     .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
     .presentMode = present_mode,
-    .clipped = VK_TRUE
+    .clipped = VK_TRUE,
+    // Set when recreating, lets the driver hand over resources.
+    .oldSwapchain = o_swapchain->swapchain_handle
   };
 
   if(ctx->graphics_queue_family != ctx->present_queue_family) {
@@ -387,16 +596,15 @@ _create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain,
     create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
   }
   
-  _VK_CHECK(ctx, vkCreateSwapchainKHR(ctx->logical_dev, &create_info, NULL, &o_swapchain->swapchain_handle));
+  _VK_CHECK(ctx, ctx->vk.CreateSwapchainKHR(ctx->logical_dev, &create_info, ctx->host.vk_alloc, &o_swapchain->swapchain_handle));
 
-  vkGetSwapchainImagesKHR(ctx->logical_dev, o_swapchain->swapchain_handle, &o_swapchain->n_imgs, NULL);
-  o_swapchain->imgs = calloc(o_swapchain->n_imgs, sizeof(VkImage));
-  vkGetSwapchainImagesKHR(ctx->logical_dev, o_swapchain->swapchain_handle, &o_swapchain->n_imgs, o_swapchain->imgs);
-
-
-  o_swapchain->img_views = calloc(o_swapchain->n_imgs, sizeof(VkImageView));
+  ctx->vk.GetSwapchainImagesKHR(ctx->logical_dev, o_swapchain->swapchain_handle, &o_swapchain->n_imgs, NULL);
+  if(!_reserve_swapchain_arrays(ctx, o_swapchain, false)) return false;
+  ctx->vk.GetSwapchainImagesKHR(ctx->logical_dev, o_swapchain->swapchain_handle, &o_swapchain->n_imgs, o_swapchain->imgs);
 
   o_swapchain->present_mode = present_mode;
+  o_swapchain->usage = usage;
+  o_swapchain->final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
   o_swapchain->fmt = fmt.format;
   o_swapchain->dimensions = extent;
   o_swapchain->logical_dev = ctx->logical_dev;
@@ -414,7 +622,7 @@ _create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain,
       }
     };
 
-    VkResult view_res = vkCreateImageView(ctx->logical_dev, &view_info, NULL, &o_swapchain->img_views[i]);
+    VkResult view_res = ctx->vk.CreateImageView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &o_swapchain->img_views[i]);
     if(view_res != VK_SUCCESS) {
       CR_ERROR(
         ctx->log, 
@@ -431,59 +639,91 @@ _create_swapchain(struct cr_context_t* ctx,  struct cr_swapchain_t* o_swapchain,
 }
 
 bool
-_create_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* o_frameloop, uint32_t graphics_queue_family) {
-  VkCommandPoolCreateInfo pool_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-    .queueFamilyIndex = graphics_queue_family, 
-    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
-  };
-
-  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
-    struct cr_frame_t* frame = &o_frameloop->frames[i];
-   
-    _VK_CHECK(ctx, vkCreateCommandPool(
-      o_frameloop->swapchain.logical_dev, &pool_info, NULL, &frame->cmd_pool));
+_reserve_swapchain_arrays(struct cr_context_t* ctx, struct cr_swapchain_t* swapchain, bool offscreen) {
+  if(swapchain->n_imgs <= swapchain->img_capacity) return true;
+
+  // Image counts only change with the present mode, so recreation rarely
+  // leaves an outgrown set of arrays behind in the arena.
+  const uint32_t n = swapchain->n_imgs;
+  swapchain->imgs = cr_arena_alloc(&ctx->host.arena, n * sizeof(VkImage), sizeof(void*));
+  swapchain->img_views = cr_arena_alloc(&ctx->host.arena, n * sizeof(VkImageView), sizeof(void*));
+  swapchain->img_mems = offscreen ? cr_arena_alloc(&ctx->host.arena, n * sizeof(VkDeviceMemory), sizeof(void*)) : NULL;
+  if(!swapchain->imgs || !swapchain->img_views || (offscreen && !swapchain->img_mems)) {
+    CR_ERROR(ctx->log, "Failed to allocate swapchain arrays (images: %i)", n);
+    return false;
+  }
+  swapchain->img_capacity = n;
+  return true;
+}
 
-    VkCommandBufferAllocateInfo buf_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-      .commandPool = frame->cmd_pool,
-      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = 1
-    };
+bool
+_create_offscreen_swapchain(struct cr_context_t* ctx, struct cr_swapchain_t* o_swapchain, uint32_t w, uint32_t h) {
+  if(w == 0 || h == 0) {
+    CR_ERROR(ctx->log, "Headless contexts need a non-zero surface size (width: %i, height: %i)", w, h);
+    return false;
+  }
 
-    _VK_CHECK(ctx, vkAllocateCommandBuffers(o_frameloop->swapchain.logical_dev, &buf_info, &frame->cmd_buf));
+  o_swapchain->swapchain_handle = VK_NULL_HANDLE;
+  o_swapchain->logical_dev = ctx->logical_dev;
+  o_swapchain->dimensions = (VkExtent2D){ .width = w, .height = h };
+  o_swapchain->fmt = VK_FORMAT_B8G8R8A8_UNORM;
+  o_swapchain->usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  o_swapchain->final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  o_swapchain->n_imgs = CR_FRAME_COUNT;
 
-    VkSemaphoreCreateInfo sem_info = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+  if(!_reserve_swapchain_arrays(ctx, o_swapchain, true)) return false;
 
-    _VK_CHECK(ctx, vkCreateSemaphore(
-      o_frameloop->swapchain.logical_dev, 
-      &sem_info, NULL, &frame->image_available)); 
+  for(uint32_t i = 0; i < o_swapchain->n_imgs; i++) {
+    VkImageCreateInfo img_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = o_swapchain->fmt,
+      .extent = { w, h, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = o_swapchain->usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    _VK_CHECK(ctx, ctx->vk.CreateImage(ctx->logical_dev, &img_info, ctx->host.vk_alloc, &o_swapchain->imgs[i]));
 
-    frame->render_finished_per_image = calloc(
-      o_frameloop->swapchain.n_imgs, 
-      sizeof(*frame->render_finished_per_image));
+    VkMemoryRequirements reqs;
+    ctx->vk.GetImageMemoryRequirements(ctx->logical_dev, o_swapchain->imgs[i], &reqs);
 
-    for(uint32_t i = 0; i < o_frameloop->swapchain.n_imgs; i++) {
-      _VK_CHECK(ctx, vkCreateSemaphore(
-        o_frameloop->swapchain.logical_dev, &sem_info, NULL, &frame->render_finished_per_image[i]));
+    if(!cr_memory_alloc(ctx, &reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                        &o_swapchain->img_mems[i], &o_swapchain->img_mem_type)) {
+      CR_ERROR(ctx->log, "Failed to allocate memory for offscreen image %i", i);
+      return false;
     }
+    o_swapchain->img_mem_size = reqs.size;
+    _VK_CHECK(ctx, ctx->vk.BindImageMemory(ctx->logical_dev, o_swapchain->imgs[i], o_swapchain->img_mems[i], 0));
 
-    VkFenceCreateInfo fence_info = {
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT
+    VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = o_swapchain->imgs[i],
+      .format = o_swapchain->fmt,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = 1, 
+        .layerCount = 1
+      }
     };
-
-    _VK_CHECK(ctx, vkCreateFence(
-      o_frameloop->swapchain.logical_dev, &fence_info, NULL, &frame->in_flight_fence));
-  
-    CR_TRACE(ctx->log, "Initialized Vulkan frameloop frame data for frame %i", 
-             i); 
+    _VK_CHECK(ctx, ctx->vk.CreateImageView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &o_swapchain->img_views[i]));
   }
 
-  o_frameloop->frame_idx = 0;
+  CR_TRACE(ctx->log, "Initialized headless offscreen images (count: %i, width: %i, height: %i)", 
+           o_swapchain->n_imgs, w, h); 
 
+  return true;
+}
+
+bool
+_create_render_pass(struct cr_context_t* ctx, VkFormat fmt, VkImageLayout final_layout, VkRenderPass* o_pass) {
   VkAttachmentDescription clear_attachment = {
-    .format = o_frameloop->swapchain.fmt,
+    .format = fmt,
     .samples = VK_SAMPLE_COUNT_1_BIT, 
 
     .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
@@ -494,7 +734,7 @@ _create_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* o_frameloop,
 
     .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 
-    .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+    .finalLayout = final_layout,
   };
 
   VkAttachmentReference clear_reference = {
@@ -529,38 +769,278 @@ _create_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* o_frameloop,
     .pDependencies = &dep,
   };
 
-  _VK_CHECK(ctx, vkCreateRenderPass(o_frameloop->swapchain.logical_dev, &pass_info, NULL, &o_frameloop->crnt_pass));
+  _VK_CHECK(ctx, ctx->vk.CreateRenderPass(ctx->logical_dev, &pass_info, ctx->host.vk_alloc, o_pass));
 
-  o_frameloop->fbs = calloc(o_frameloop->swapchain.n_imgs, sizeof(*o_frameloop->fbs));
+  CR_TRACE(ctx->log, "Initialized Vulkan render pass (format: %i)", fmt);
+
+  return true;
+}
+
+bool
+_create_output(struct cr_context_t* ctx, struct cr_output_t* out) {
+  if(out->surf.surf) {
+    if(!_create_swapchain(ctx, &out->swapchain, out->surf.surf, out->surf.width, out->surf.height)) {
+      CR_ERROR(ctx->log, "Failed to create Vulkan swap chain (width: %i, height: %i)", 
+               out->surf.width, out->surf.height);
+      return false;
+    }
+  } else {
+    if(!_create_offscreen_swapchain(ctx, &out->swapchain, out->surf.width, out->surf.height)) {
+      CR_ERROR(ctx->log, "Failed to create offscreen images (width: %i, height: %i)", 
+               out->surf.width, out->surf.height);
+      return false;
+    }
+  }
+  struct cr_swapchain_t* swapchain = &out->swapchain;
+
+  // Monitors normally agree on the format; otherwise the output needs a
+  // render pass of its own.
+  const struct cr_output_t* primary = &ctx->outputs[0];
+  if(out == primary || swapchain->fmt == primary->swapchain.fmt) {
+    out->pass = ctx->frameloop.crnt_pass;
+    out->owns_pass = false;
+  } else {
+    if(!_create_render_pass(ctx, swapchain->fmt, swapchain->final_layout, &out->pass)) return false;
+    out->owns_pass = true;
+    CR_WARN(ctx->log, "Output format %i differs from the primary output, pipelines of the context render "
+            "pass are not compatible with it.", swapchain->fmt);
+  }
+
+  VkSemaphoreCreateInfo sem_info = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    _VK_CHECK(ctx, ctx->vk.CreateSemaphore(ctx->logical_dev, &sem_info, ctx->host.vk_alloc, &out->image_available[i]));
+  }
+
+  if(!_create_output_images(ctx, out)) return false;
+
+  CR_TRACE(ctx->log, "Initialized output (width: %i, height: %i, images: %i, headless: %s)", 
+           swapchain->dimensions.width, swapchain->dimensions.height, swapchain->n_imgs,
+           out->surf.surf ? "false" : "true"); 
+
+  return true;
+}
+
+bool
+_create_output_images(struct cr_context_t* ctx, struct cr_output_t* out) {
+  struct cr_swapchain_t* swapchain = &out->swapchain;
+
+  if(swapchain->n_imgs > out->img_capacity) {
+    const uint32_t n = swapchain->n_imgs;
+    out->fbs = cr_arena_alloc(&ctx->host.arena, n * sizeof(*out->fbs), sizeof(void*));
+    out->image_fences = cr_arena_alloc(&ctx->host.arena, n * sizeof(*out->image_fences), sizeof(void*));
+    out->render_finished_per_image = cr_arena_alloc(
+      &ctx->host.arena, n * sizeof(*out->render_finished_per_image), sizeof(void*));
+    if(!out->fbs || !out->image_fences || !out->render_finished_per_image) return false;
+    out->img_capacity = n;
+  }
+
+  VkSemaphoreCreateInfo sem_info = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+  for(uint32_t i = 0; i < swapchain->n_imgs; i++) {
+    _VK_CHECK(ctx, ctx->vk.CreateSemaphore(ctx->logical_dev, &sem_info, ctx->host.vk_alloc, &out->render_finished_per_image[i]));
 
-  for(uint32_t i = 0; i < o_frameloop->swapchain.n_imgs; i++) {
     VkImageView attachments[] = {
-      o_frameloop->swapchain.img_views[i]
+      swapchain->img_views[i]
     };
 
     VkFramebufferCreateInfo fb_info = {
       .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-      .renderPass = o_frameloop->crnt_pass,
+      .renderPass = out->pass,
       .attachmentCount = 1,
       .pAttachments = attachments, 
-      .width = o_frameloop->swapchain.dimensions.width,
-      .height = o_frameloop->swapchain.dimensions.height,
+      .width = swapchain->dimensions.width,
+      .height = swapchain->dimensions.height,
       .layers = 1
     };
 
-    _VK_CHECK(ctx, vkCreateFramebuffer(o_frameloop->swapchain.logical_dev, &fb_info, NULL, 
-                                       &o_frameloop->fbs[i]) != VK_SUCCESS);
-    
-    CR_TRACE(ctx->log, "Initialized Vulkan frameloop framebuffer for swapchain image view %i", 
+    _VK_CHECK(ctx, ctx->vk.CreateFramebuffer(ctx->logical_dev, &fb_info, ctx->host.vk_alloc, &out->fbs[i]));
+  }
+
+  return true;
+}
+
+void
+_retire_output_images(struct cr_context_t* ctx, struct cr_output_t* out) {
+  struct cr_swapchain_t* swapchain = &out->swapchain;
+
+  // Arrays are only partially filled when creation failed halfway.
+  for(uint32_t i = 0; i < swapchain->n_imgs; i++) {
+    if(out->fbs && out->fbs[i]) {
+      cr_deletion_push(ctx, CR_DELETION_FRAMEBUFFER, (union cr_deletion_handle_t){ .framebuffer = out->fbs[i] });
+    }
+    if(out->render_finished_per_image && out->render_finished_per_image[i]) {
+      cr_deletion_push(ctx, CR_DELETION_SEMAPHORE,
+                       (union cr_deletion_handle_t){ .semaphore = out->render_finished_per_image[i] });
+    }
+    if(swapchain->img_views && swapchain->img_views[i]) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE_VIEW, (union cr_deletion_handle_t){ .image_view = swapchain->img_views[i] });
+    }
+    // Swapchain images belong to the swapchain; only offscreen ones are ours.
+    if(swapchain->img_mems && swapchain->imgs && swapchain->imgs[i]) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE, (union cr_deletion_handle_t){ .image = swapchain->imgs[i] });
+    }
+    if(swapchain->img_mems && swapchain->img_mems[i]) {
+      union cr_deletion_handle_t h = { .memory = { swapchain->img_mems[i], swapchain->img_mem_size, swapchain->img_mem_type } };
+      cr_deletion_push(ctx, CR_DELETION_MEMORY, h);
+    }
+  }
+  if(swapchain->swapchain_handle) {
+    cr_deletion_push(ctx, CR_DELETION_SWAPCHAIN, (union cr_deletion_handle_t){ .swapchain = swapchain->swapchain_handle });
+  }
+
+  // The arrays stay with the output for the next swapchain.
+  const uint32_t n = swapchain->n_imgs;
+  if(out->fbs) memset(out->fbs, 0, n * sizeof *out->fbs);
+  if(out->image_fences) memset(out->image_fences, 0, n * sizeof *out->image_fences);
+  if(out->render_finished_per_image) {
+    memset(out->render_finished_per_image, 0, n * sizeof *out->render_finished_per_image);
+  }
+  if(swapchain->imgs) memset(swapchain->imgs, 0, n * sizeof *swapchain->imgs);
+  if(swapchain->img_views) memset(swapchain->img_views, 0, n * sizeof *swapchain->img_views);
+  if(swapchain->img_mems) memset(swapchain->img_mems, 0, n * sizeof *swapchain->img_mems);
+  swapchain->swapchain_handle = VK_NULL_HANDLE;
+  swapchain->n_imgs = 0;
+}
+
+bool
+_recreate_output(struct cr_context_t* ctx, struct cr_output_t* out) {
+  VkSurfaceCapabilitiesKHR caps;
+  _VK_CHECK(ctx, ctx->vk.GetPhysicalDeviceSurfaceCapabilitiesKHR(ctx->phys_dev, out->surf.surf, &caps));
+  // Minimized windows report a zero extent; stay stale until restored.
+  if(caps.currentExtent.width == 0 || caps.currentExtent.height == 0) return true;
+
+  // Objects of the old swapchain may still be used by frames in flight;
+  // they are retired rather than destroyed, which also frees the arrays
+  // for reuse. The new swapchain is chained to the old one.
+  const VkSwapchainKHR old_handle = out->swapchain.swapchain_handle;
+  const VkFormat old_fmt = out->swapchain.fmt;
+  _retire_output_images(ctx, out);
+
+  out->swapchain.swapchain_handle = old_handle;
+  bool created = _create_swapchain(ctx, &out->swapchain, out->surf.surf, out->surf.width, out->surf.height);
+  if(out->swapchain.swapchain_handle == old_handle) out->swapchain.swapchain_handle = VK_NULL_HANDLE;
+  if(!created) {
+    CR_ERROR(ctx->log, "Failed to recreate Vulkan swap chain (width: %i, height: %i)", 
+             out->surf.width, out->surf.height);
+    return false;
+  }
+
+  if(out->swapchain.fmt != old_fmt) {
+    CR_ERROR(ctx->log, "Surface format changed from %i to %i, the output render pass is incompatible.",
+             old_fmt, out->swapchain.fmt);
+    return false;
+  }
+  if(!_create_output_images(ctx, out)) return false;
+
+  out->stale = false;
+
+  CR_TRACE(ctx->log, "Recreated output swapchain (width: %i, height: %i, images: %i)", 
+           out->swapchain.dimensions.width, out->swapchain.dimensions.height, out->swapchain.n_imgs);
+
+  return true;
+}
+
+void
+_destroy_output(struct cr_context_t* ctx, struct cr_output_t* out) {
+  _retire_output_images(ctx, out);
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    if(out->image_available[i]) {
+      cr_deletion_push(ctx, CR_DELETION_SEMAPHORE, (union cr_deletion_handle_t){ .semaphore = out->image_available[i] });
+    }
+  }
+  if(out->owns_pass && out->pass) {
+    cr_deletion_push(ctx, CR_DELETION_RENDER_PASS, (union cr_deletion_handle_t){ .render_pass = out->pass });
+  }
+  // The surface outlives its swapchain, it is destroyed once the deletion
+  // queue is drained.
+  struct cr_surface_t surf = out->surf;
+  memset(out, 0, sizeof *out);
+  out->surf = surf;
+}
+
+bool
+_create_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* o_frameloop, uint32_t graphics_queue_family) {
+  VkCommandPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .queueFamilyIndex = graphics_queue_family, 
+    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+  };
+
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    struct cr_frame_t* frame = &o_frameloop->frames[i];
+   
+    _VK_CHECK(ctx, ctx->vk.CreateCommandPool(
+      ctx->logical_dev, &pool_info, ctx->host.vk_alloc, &frame->cmd_pool));
+
+    VkCommandBufferAllocateInfo buf_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = frame->cmd_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1
+    };
+
+    _VK_CHECK(ctx, ctx->vk.AllocateCommandBuffers(ctx->logical_dev, &buf_info, &frame->cmd_buf));
+
+    VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT
+    };
+
+    _VK_CHECK(ctx, ctx->vk.CreateFence(
+      ctx->logical_dev, &fence_info, ctx->host.vk_alloc, &frame->in_flight_fence));
+
+    // Upload memory is created on the first upload of the frame.
+    frame->upload_offset = 0;
+    frame->begun = false;
+  
+    CR_TRACE(ctx->log, "Initialized Vulkan frameloop frame data for frame %i", 
              i); 
   }
-    
+
+  o_frameloop->frame_idx = 0;
+
   CR_TRACE(ctx->log, "Initialized Vulkan frameloop."); 
 
-  o_frameloop->swapchain_image_fences = calloc(
-    o_frameloop->swapchain.n_imgs, sizeof(*o_frameloop->swapchain_image_fences));
   return true;
+}
+
+void
+_destroy_frameloop(struct cr_context_t* ctx, struct cr_frameloop_t* frameloop) {
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    struct cr_frame_t* frame = &frameloop->frames[i];
+    cr_buffer_destroy(ctx, &frame->upload);
+    if(frame->scratch.ctx) cr_arena_destroy(&frame->scratch);
+    // Destroying the pool frees its command buffer.
+    if(frame->cmd_pool) ctx->vk.DestroyCommandPool(ctx->logical_dev, frame->cmd_pool, ctx->host.vk_alloc);
+    if(frame->in_flight_fence) ctx->vk.DestroyFence(ctx->logical_dev, frame->in_flight_fence, ctx->host.vk_alloc);
+  }
+  if(frameloop->crnt_pass) {
+    ctx->vk.DestroyRenderPass(ctx->logical_dev, frameloop->crnt_pass, ctx->host.vk_alloc);
+  }
+  memset(frameloop, 0, sizeof *frameloop);
+}
 
+bool
+_create_capture(struct cr_context_t* ctx, const struct cr_context_init_info_t* info) {
+  ctx->capture = cr_host_calloc(ctx, 1, sizeof *ctx->capture);
+  if(!ctx->capture || !cr_capture_open(ctx->capture, info->capture_path)) {
+    cr_host_free(ctx, ctx->capture);
+    ctx->capture = NULL;
+    return false;
+  }
+
+  struct cr_capture_init_t* rec = cr_capture_record(ctx->capture, CR_CAPTURE_RECORD_INIT, sizeof *rec);
+  if(rec) {
+    *rec = (struct cr_capture_init_t){
+      .width = ctx->outputs[0].swapchain.dimensions.width,
+      .height = ctx->outputs[0].swapchain.dimensions.height,
+      .enable_validation = info->enable_validation
+    };
+  }
+
+  CR_TRACE(ctx->log, "Capturing API calls to '%s'", info->capture_path);
+  return true;
 }
 
 bool 
@@ -570,51 +1050,151 @@ cr_context_create(struct cr_context_t* ctx, const struct cr_context_init_info_t*
     CR_ERROR(ctx->log, "Failed to create logging context.");
     return false;
   }
+  if(!cr_host_init(ctx, &info->host)) {
+    CR_ERROR(ctx->log, "Failed to initialize host allocation tracking.");
+    return false;
+  }
   if(!_create_rendering_context(ctx, info)) {
     CR_ERROR(ctx->log, "Failed to create rendering context.");
     return false;
   } 
 
+  if(info->capture_path && !_create_capture(ctx, info)) {
+    CR_ERROR(ctx->log, "Failed to open capture stream '%s'.", info->capture_path);
+    return false;
+  }
+
   return true;
 }
 bool 
 cr_context_destroy(struct cr_context_t* ctx) {
+  if(ctx->capture) {
+    cr_capture_close(ctx->capture);
+    cr_host_free(ctx, ctx->capture);
+    ctx->capture = NULL;
+  }
+
+  if(ctx->logical_dev) {
+    ctx->vk.DeviceWaitIdle(ctx->logical_dev);
+
+    if(ctx->pipeline_cache.handle) {
+      cr_pipeline_cache_save(ctx, &ctx->pipeline_cache);
+      cr_pipeline_cache_destroy(ctx, &ctx->pipeline_cache);
+    }
+    cr_readback_destroy(ctx);
+
+    for(uint32_t i = 0; i < CR_MAX_OUTPUTS; i++) {
+      _destroy_output(ctx, &ctx->outputs[i]);
+    }
+    ctx->n_outputs = 0;
+    _destroy_frameloop(ctx, &ctx->frameloop);
+    cr_deletion_destroy(ctx);
+
+    // Anything still allocated here was leaked by the caller (draw lists,
+    // graphs, buffers).
+    for(uint32_t i = 0; i < ctx->memory.stats.n_heaps; i++) {
+      const struct cr_memory_heap_stats_t* heap = &ctx->memory.stats.heaps[i];
+      if(heap->n_allocs > 0) {
+        CR_WARN(ctx->log, "Heap %i still holds %i allocations (%lu bytes) at teardown.",
+                i, heap->n_allocs, (unsigned long)heap->own);
+      }
+    }
+
+    ctx->vk.DestroyDevice(ctx->logical_dev, ctx->host.vk_alloc);
+    ctx->logical_dev = VK_NULL_HANDLE;
+  }
+
+  for(uint32_t i = 0; i < CR_MAX_OUTPUTS; i++) {
+    if(ctx->outputs[i].surf.surf && ctx->vk.DestroySurfaceKHR) ctx->vk.DestroySurfaceKHR(ctx->instance, ctx->outputs[i].surf.surf, NULL);
+    ctx->outputs[i].surf.surf = VK_NULL_HANDLE;
+  }
+
+  if(ctx->instance) {
+    ctx->vk.DestroyInstance(ctx->instance, ctx->host.vk_alloc);
+    ctx->instance = VK_NULL_HANDLE;
+  }
+  cr_dispatch_unload(ctx);
+
+  cr_host_destroy(ctx);
+
+  CR_TRACE(ctx->log, "Destroyed context.");
+
+  if(ctx->log.stream && ctx->log.stream != stdout) {
+    fclose(ctx->log.stream);
+  }
+  memset(ctx, 0, sizeof *ctx);
   return true;
 }
 bool 
-cr_draw_frame(struct cr_context_t* ctx) {
+cr_frame_begin(struct cr_context_t* ctx) {
+  struct cr_frame_t* frame = &ctx->frameloop.frames[ctx->frameloop.frame_idx];
+  if(frame->begun) return true;
 
-struct cr_frame_t* frame = &ctx->frameloop.frames[ctx->frameloop.frame_idx];
-  _VK_CHECK(ctx, vkWaitForFences(ctx->logical_dev, 1, &frame->in_flight_fence, VK_TRUE, UINT64_MAX));
-
-  uint32_t image_idx = 0;
-  VkResult res = vkAcquireNextImageKHR(
-    ctx->logical_dev,
-    ctx->swapchain.swapchain_handle,
-    UINT64_MAX,
-    frame->image_available,
-    VK_NULL_HANDLE, 
-    &image_idx
-  );
-  if(ctx->frameloop.swapchain_image_fences[image_idx] != VK_NULL_HANDLE) {
-    vkWaitForFences(ctx->logical_dev, 1, &ctx->frameloop.swapchain_image_fences[image_idx], VK_TRUE,
-                    UINT64_MAX);
-  }
-  ctx->frameloop.swapchain_image_fences[image_idx] = frame->in_flight_fence;
-
-  if(res == VK_ERROR_OUT_OF_DATE_KHR) {
-    return true;
+  _VK_CHECK(ctx, ctx->vk.WaitForFences(ctx->logical_dev, 1, &frame->in_flight_fence, VK_TRUE, UINT64_MAX));
+  if(frame->submitted_no > ctx->frameloop.completed_no) {
+    ctx->frameloop.completed_no = frame->submitted_no;
   }
-  if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) return false;
+  frame->upload_offset = 0;
+  if(frame->scratch.ctx) cr_arena_reset(&frame->scratch);
+  frame->begun = true;
 
-  _VK_CHECK(ctx, vkResetFences(ctx->logical_dev, 1, &frame->in_flight_fence));
-  _VK_CHECK(ctx, vkResetCommandPool(ctx->logical_dev, frame->cmd_pool, 0));
+  cr_deletion_flush(ctx, ctx->frameloop.completed_no);
+  cr_memory_update_budget(ctx);
+  return true;
+}
 
-  VkCommandBufferBeginInfo begin_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
-  };
+bool
+_acquire_output(struct cr_context_t* ctx, struct cr_output_t* out, uint32_t frame_idx) {
+  out->acquired = false;
 
-  _VK_CHECK(ctx, vkBeginCommandBuffer(frame->cmd_buf, &begin_info));
+  if(out->stale) {
+    if(!_recreate_output(ctx, out)) return false;
+    if(out->stale) return true;
+  }
+
+  // Headless outputs own one offscreen image per frame in flight.
+  if(!out->swapchain.swapchain_handle) {
+    out->image_idx = frame_idx;
+  } else {
+    VkResult res = ctx->vk.AcquireNextImageKHR(
+      ctx->logical_dev,
+      out->swapchain.swapchain_handle,
+      UINT64_MAX,
+      out->image_available[frame_idx],
+      VK_NULL_HANDLE, 
+      &out->image_idx
+    );
+    if(res == VK_ERROR_OUT_OF_DATE_KHR) {
+      out->stale = true;
+      return true;
+    }
+    if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR) {
+      CR_ERROR(ctx->log, "Failed to acquire swapchain image: %s", cr_util_vk_result_to_string(res));
+      return false;
+    }
+  }
+
+  VkFence* image_fence = &out->image_fences[out->image_idx];
+  if(*image_fence != VK_NULL_HANDLE) {
+    ctx->vk.WaitForFences(ctx->logical_dev, 1, image_fence, VK_TRUE, UINT64_MAX);
+  }
+  *image_fence = ctx->frameloop.frames[frame_idx].in_flight_fence;
+
+  out->acquired = true;
+  return true;
+}
+
+bool
+_record_output(struct cr_context_t* ctx, struct cr_output_t* out, VkCommandBuffer cmd, uint32_t frame_idx) {
+  if(out->graph) {
+    cr_graph_set_image(out->graph, out->graph_target,
+                       out->swapchain.imgs[out->image_idx], out->swapchain.img_views[out->image_idx]);
+    if(!cr_graph_execute(ctx, out->graph, cmd)) {
+      CR_ERROR(ctx->log, "Failed to execute render graph.");
+      return false;
+    }
+    return true;
+  }
 
   VkClearValue clear = {
     .color = {
@@ -623,48 +1203,196 @@ struct cr_frame_t* frame = &ctx->frameloop.frames[ctx->frameloop.frame_idx];
   };
   VkRenderPassBeginInfo renderpass_info = {
     .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-    .renderPass = ctx->frameloop.crnt_pass,
-    .framebuffer = ctx->frameloop.fbs[image_idx],
+    .renderPass = out->pass,
+    .framebuffer = out->fbs[out->image_idx],
     .renderArea = {
       .offset = {0, 0},
-      .extent = ctx->swapchain.dimensions
+      .extent = out->swapchain.dimensions
     },
     .pClearValues = &clear,
     .clearValueCount = 1
   };
 
-  vkCmdBeginRenderPass(frame->cmd_buf, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+  ctx->vk.CmdBeginRenderPass(cmd, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+  if(out->draw_list) {
+    if(!cr_draw_list_record(ctx, out->draw_list, cmd, frame_idx, renderpass_info.renderArea)) {
+      CR_ERROR(ctx->log, "Failed to record draw list.");
+      return false;
+    }
+  }
+  if(out->text) {
+    if(!cr_text_record(ctx, out->text, cmd, renderpass_info.renderArea)) {
+      CR_ERROR(ctx->log, "Failed to record text.");
+      return false;
+    }
+  }
+
+  ctx->vk.CmdEndRenderPass(cmd);
+  return true;
+}
 
-  vkCmdEndRenderPass(frame->cmd_buf);
-  _VK_CHECK(ctx, vkEndCommandBuffer(frame->cmd_buf));
+bool
+cr_output_add(
+  struct cr_context_t* ctx,
+  cr_surface_create_func_t surface_create,
+  void* userdata,
+  uint32_t* o_idx) {
+  if(ctx->n_outputs == CR_MAX_OUTPUTS) {
+    CR_ERROR(ctx->log, "Too many outputs (max: %i)", CR_MAX_OUTPUTS);
+    return false;
+  }
+  if(!ctx->outputs[0].surf.surf) {
+    CR_ERROR(ctx->log, "Headless contexts cannot present to additional outputs.");
+    return false;
+  }
 
-  VkPipelineStageFlags pipeline_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  struct cr_output_t* out = &ctx->outputs[ctx->n_outputs];
+  memset(out, 0, sizeof *out);
+  if(!surface_create(ctx->instance, &out->surf, userdata) || !out->surf.surf) {
+    CR_ERROR(ctx->log, "Failed to create platform surface for output %i.", ctx->n_outputs);
+    return false;
+  }
+
+  // Every output is presented from the context's present queue.
+  VkBool32 supported = VK_FALSE;
+  ctx->vk.GetPhysicalDeviceSurfaceSupportKHR(ctx->phys_dev, ctx->present_queue_family, out->surf.surf, &supported);
+  if(!supported) {
+    CR_ERROR(ctx->log, "Present queue family %i cannot present to output %i.",
+             ctx->present_queue_family, ctx->n_outputs);
+    return false;
+  }
+
+  if(!_create_output(ctx, out)) return false;
+
+  if(o_idx) *o_idx = ctx->n_outputs;
+  ctx->n_outputs++;
+  return true;
+}
+
+bool
+cr_output_resize(struct cr_context_t* ctx, uint32_t idx, uint32_t width, uint32_t height) {
+  if(idx >= ctx->n_outputs) return false;
+
+  struct cr_output_t* out = &ctx->outputs[idx];
+  if(!out->surf.surf) {
+    CR_ERROR(ctx->log, "Headless outputs cannot be resized.");
+    return false;
+  }
+  out->surf.width = width;
+  out->surf.height = height;
+  out->stale = true;
+  if(idx == 0) cr_readback_invalidate(ctx);
+  return true;
+}
+
+bool 
+cr_draw_frame(struct cr_context_t* ctx) {
+  if(!cr_frame_begin(ctx)) return false;
+
+  const uint32_t frame_idx = ctx->frameloop.frame_idx;
+  struct cr_frame_t* frame = &ctx->frameloop.frames[frame_idx];
+
+  uint32_t n_acquired = 0;
+  for(uint32_t i = 0; i < ctx->n_outputs; i++) {
+    if(!_acquire_output(ctx, &ctx->outputs[i], frame_idx)) return false;
+    if(ctx->outputs[i].acquired) n_acquired++;
+  }
+  // Every output is out of date; the frame stays begun for the next call.
+  if(n_acquired == 0) return true;
+
+  _VK_CHECK(ctx, ctx->vk.ResetFences(ctx->logical_dev, 1, &frame->in_flight_fence));
+  _VK_CHECK(ctx, ctx->vk.ResetCommandPool(ctx->logical_dev, frame->cmd_pool, 0));
+
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+  };
+
+  _VK_CHECK(ctx, ctx->vk.BeginCommandBuffer(frame->cmd_buf, &begin_info));
+
+  if(!cr_texture_record_uploads(ctx, frame->cmd_buf) || !cr_atlas_record_uploads(ctx, frame->cmd_buf)) {
+    CR_ERROR(ctx->log, "Failed to record texture uploads.");
+    return false;
+  }
+
+  for(uint32_t i = 0; i < ctx->n_outputs; i++) {
+    struct cr_output_t* out = &ctx->outputs[i];
+    if(out->acquired && !_record_output(ctx, out, frame->cmd_buf, frame_idx)) return false;
+  }
+
+  const struct cr_output_t* primary = &ctx->outputs[0];
+  if(primary->acquired &&
+     !cr_readback_record(ctx, frame->cmd_buf, primary->swapchain.imgs[primary->image_idx], frame_idx)) {
+    CR_ERROR(ctx->log, "Failed to record readback.");
+    return false;
+  }
+  _VK_CHECK(ctx, ctx->vk.EndCommandBuffer(frame->cmd_buf));
+
+  cr_capture_frame(ctx);
+
+  // One submission covers every output: it waits for all acquires and
+  // signals one semaphore per presented image.
+  VkSemaphore wait_sems[CR_MAX_OUTPUTS], signal_sems[CR_MAX_OUTPUTS];
+  VkPipelineStageFlags wait_stages[CR_MAX_OUTPUTS];
+  VkSwapchainKHR swapchains[CR_MAX_OUTPUTS];
+  uint32_t image_idxs[CR_MAX_OUTPUTS], output_idxs[CR_MAX_OUTPUTS];
+  uint32_t n_present = 0;
+  for(uint32_t i = 0; i < ctx->n_outputs; i++) {
+    const struct cr_output_t* out = &ctx->outputs[i];
+    if(!out->acquired || !out->swapchain.swapchain_handle) continue;
+
+    wait_sems[n_present] = out->image_available[frame_idx];
+    wait_stages[n_present] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    signal_sems[n_present] = out->render_finished_per_image[out->image_idx];
+    swapchains[n_present] = out->swapchain.swapchain_handle;
+    image_idxs[n_present] = out->image_idx;
+    output_idxs[n_present] = i;
+    n_present++;
+  }
 
   VkSubmitInfo submit_info = {
     .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .waitSemaphoreCount = 1, 
-    .pWaitSemaphores = &frame->image_available,
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = &frame->render_finished_per_image[image_idx],
-    .pWaitDstStageMask  = &pipeline_flags, 
+    .waitSemaphoreCount = n_present, 
+    .pWaitSemaphores = wait_sems,
+    .signalSemaphoreCount = n_present,
+    .pSignalSemaphores = signal_sems,
+    .pWaitDstStageMask  = wait_stages, 
     .commandBufferCount = 1,
     .pCommandBuffers = &frame->cmd_buf,
   };
 
-  _VK_CHECK(ctx, vkQueueSubmit(ctx->graphics_queue, 1, &submit_info, frame->in_flight_fence));
+  _VK_CHECK(ctx, ctx->vk.QueueSubmit(ctx->graphics_queue, 1, &submit_info, frame->in_flight_fence));
+  frame->submitted_no = ++ctx->frameloop.frame_no;
+
+  frame->begun = false;
+  ctx->frameloop.frame_idx = (ctx->frameloop.frame_idx + 1) % CR_FRAME_COUNT;
+
+  if(n_present == 0) return true;
 
+  VkResult results[CR_MAX_OUTPUTS];
   VkPresentInfoKHR present_info = {
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &frame->render_finished_per_image[image_idx],
-    .swapchainCount = 1,
-    .pSwapchains = &ctx->swapchain.swapchain_handle,
-    .pImageIndices = &image_idx
+    .waitSemaphoreCount = n_present,
+    .pWaitSemaphores = signal_sems,
+    .swapchainCount = n_present,
+    .pSwapchains = swapchains,
+    .pImageIndices = image_idxs,
+    .pResults = results
   };
 
-  _VK_CHECK(ctx, vkQueuePresentKHR(ctx->present_queue, &present_info));
+  VkResult res = ctx->vk.QueuePresentKHR(ctx->present_queue, &present_info);
+  if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR && res != VK_ERROR_OUT_OF_DATE_KHR) {
+    CR_ERROR(ctx->log, "Failed to present: %s", cr_util_vk_result_to_string(res));
+    return false;
+  }
+  for(uint32_t i = 0; i < n_present; i++) {
+    if(results[i] != VK_SUCCESS) {
+      CR_TRACE(ctx->log, "Present of output %i returned %s", output_idxs[i], cr_util_vk_result_to_string(results[i]));
+    }
+    if(results[i] == VK_SUBOPTIMAL_KHR || results[i] == VK_ERROR_OUT_OF_DATE_KHR) {
+      ctx->outputs[output_idxs[i]].stale = true;
+    }
+  }
 
-  ctx->frameloop.frame_idx = (ctx->frameloop.frame_idx + 1) % CR_FRAME_COUNT;
   return true;
-
 }
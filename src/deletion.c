@@ -0,0 +1,145 @@
+#include "../include/corender/deletion.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "DELETION"
+
+static void _destroy(struct cr_context_t* ctx, struct cr_deletion_t* entry);
+static bool _reserve(struct cr_context_t* ctx, struct cr_deletion_queue_t* queue);
+
+void
+_destroy(struct cr_context_t* ctx, struct cr_deletion_t* entry) {
+  VkDevice dev = ctx->logical_dev;
+  union cr_deletion_handle_t* h = &entry->handle;
+
+  switch(entry->type) {
+    case CR_DELETION_BUFFER:
+      cr_buffer_destroy(ctx, &h->buffer);
+      break;
+    case CR_DELETION_MEMORY:
+      cr_memory_free(ctx, h->memory.handle, h->memory.size, h->memory.type);
+      break;
+    case CR_DELETION_BUFFER_VIEW:
+      ctx->vk.DestroyBufferView(dev, h->buffer_view, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_IMAGE:
+      ctx->vk.DestroyImage(dev, h->image, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_IMAGE_VIEW:
+      ctx->vk.DestroyImageView(dev, h->image_view, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_FRAMEBUFFER:
+      ctx->vk.DestroyFramebuffer(dev, h->framebuffer, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_RENDER_PASS:
+      ctx->vk.DestroyRenderPass(dev, h->render_pass, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_SEMAPHORE:
+      ctx->vk.DestroySemaphore(dev, h->semaphore, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_FENCE:
+      ctx->vk.DestroyFence(dev, h->fence, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_SWAPCHAIN:
+      ctx->vk.DestroySwapchainKHR(dev, h->swapchain, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_PIPELINE:
+      ctx->vk.DestroyPipeline(dev, h->pipeline, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_PIPELINE_LAYOUT:
+      ctx->vk.DestroyPipelineLayout(dev, h->pipeline_layout, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_SHADER_MODULE:
+      ctx->vk.DestroyShaderModule(dev, h->shader_module, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_SAMPLER:
+      ctx->vk.DestroySampler(dev, h->sampler, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_DESCRIPTOR_POOL:
+      ctx->vk.DestroyDescriptorPool(dev, h->descriptor_pool, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_DESCRIPTOR_SET_LAYOUT:
+      ctx->vk.DestroyDescriptorSetLayout(dev, h->descriptor_set_layout, ctx->host.vk_alloc);
+      break;
+    case CR_DELETION_COMMAND_POOL:
+      ctx->vk.DestroyCommandPool(dev, h->command_pool, ctx->host.vk_alloc);
+      break;
+  }
+  ctx->deletion.n_destroyed++;
+}
+
+bool
+_reserve(struct cr_context_t* ctx, struct cr_deletion_queue_t* queue) {
+  if(queue->head + queue->n < queue->cap) return true;
+
+  // Reuse the space flushed entries left at the front before growing.
+  if(queue->head > 0) {
+    memmove(queue->entries, queue->entries + queue->head, queue->n * sizeof *queue->entries);
+    queue->head = 0;
+    return true;
+  }
+
+  uint32_t cap = queue->cap ? queue->cap * 2 : 64;
+  struct cr_deletion_t* entries = cr_host_realloc(ctx, queue->entries, cap * sizeof *entries);
+  if(!entries) return false;
+  queue->entries = entries;
+  queue->cap = cap;
+  return true;
+}
+
+bool
+cr_deletion_push(struct cr_context_t* ctx, enum cr_deletion_type_t type, union cr_deletion_handle_t handle) {
+  struct cr_deletion_queue_t* queue = &ctx->deletion;
+  struct cr_deletion_t entry = {
+    .type = type,
+    .handle = handle,
+    // The frame being built may still record uses of the object.
+    .retire_no = ctx->frameloop.frame_no + 1
+  };
+
+  if(!_reserve(ctx, queue)) {
+    CR_WARN(ctx->log, "Failed to grow deletion queue, waiting for the device to destroy object (type: %i)", type);
+    ctx->vk.DeviceWaitIdle(ctx->logical_dev);
+    _destroy(ctx, &entry);
+    return false;
+  }
+
+  queue->entries[queue->head + queue->n++] = entry;
+  return true;
+}
+
+bool
+cr_deletion_push_buffer(struct cr_context_t* ctx, struct cr_buffer_t* buf) {
+  if(!buf->handle && !buf->mem) return true;
+
+  bool ok = cr_deletion_push(ctx, CR_DELETION_BUFFER, (union cr_deletion_handle_t){ .buffer = *buf });
+  memset(buf, 0, sizeof *buf);
+  return ok;
+}
+
+void
+cr_deletion_flush(struct cr_context_t* ctx, uint64_t completed_no) {
+  struct cr_deletion_queue_t* queue = &ctx->deletion;
+
+  uint32_t n_flushed = 0;
+  while(queue->n > 0 && queue->entries[queue->head].retire_no <= completed_no) {
+    _destroy(ctx, &queue->entries[queue->head]);
+    queue->head++;
+    queue->n--;
+    n_flushed++;
+  }
+  if(queue->n == 0) queue->head = 0;
+
+  if(n_flushed > 0) {
+    CR_TRACE(ctx->log, "Destroyed %i retired objects (pending: %i)", n_flushed, queue->n);
+  }
+}
+
+void
+cr_deletion_destroy(struct cr_context_t* ctx) {
+  cr_deletion_flush(ctx, UINT64_MAX);
+  cr_host_free(ctx, ctx->deletion.entries);
+  memset(&ctx->deletion, 0, sizeof ctx->deletion);
+}
@@ -0,0 +1,102 @@
+#include "../include/corender/dispatch.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <dlfcn.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "DISPATCH"
+
+#define _LOADER_NAME "libvulkan.so.1"
+
+#define _LOAD_GLOBAL(name) \
+  vk->name = (PFN_vk##name)vk->GetInstanceProcAddr(VK_NULL_HANDLE, "vk" #name); \
+  if(!vk->name) missing = "vk" #name;
+#define _LOAD_INSTANCE(name) \
+  vk->name = (PFN_vk##name)vk->GetInstanceProcAddr(ctx->instance, "vk" #name); \
+  if(!vk->name) missing = "vk" #name;
+#define _LOAD_INSTANCE_OPTIONAL(name) \
+  vk->name = (PFN_vk##name)vk->GetInstanceProcAddr(ctx->instance, "vk" #name);
+#define _LOAD_DEVICE(name) \
+  vk->name = (PFN_vk##name)vk->GetDeviceProcAddr(ctx->logical_dev, "vk" #name); \
+  if(!vk->name) missing = "vk" #name;
+#define _LOAD_DEVICE_OPTIONAL(name) \
+  vk->name = (PFN_vk##name)vk->GetDeviceProcAddr(ctx->logical_dev, "vk" #name);
+
+bool
+cr_dispatch_load(struct cr_context_t* ctx, PFN_vkGetInstanceProcAddr get_instance_proc_addr) {
+  struct cr_dispatch_t* vk = &ctx->vk;
+  memset(vk, 0, sizeof *vk);
+
+  if(get_instance_proc_addr) {
+    vk->GetInstanceProcAddr = get_instance_proc_addr;
+  } else {
+    vk->loader = dlopen(_LOADER_NAME, RTLD_NOW | RTLD_LOCAL);
+    if(!vk->loader) {
+      CR_ERROR(ctx->log, "Failed to open the Vulkan loader (%s): %s", _LOADER_NAME, dlerror());
+      return false;
+    }
+    vk->GetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)dlsym(vk->loader, "vkGetInstanceProcAddr");
+    if(!vk->GetInstanceProcAddr) {
+      CR_ERROR(ctx->log, "%s does not export vkGetInstanceProcAddr.", _LOADER_NAME);
+      return false;
+    }
+  }
+
+  const char* missing = NULL;
+  CR_VK_GLOBAL_FUNCS(_LOAD_GLOBAL)
+  if(missing) {
+    CR_ERROR(ctx->log, "Failed to load global Vulkan function %s.", missing);
+    return false;
+  }
+
+  CR_TRACE(ctx->log, "Loaded Vulkan global functions (loader: %s)", vk->loader ? _LOADER_NAME : "caller");
+  return true;
+}
+
+bool
+cr_dispatch_load_instance(struct cr_context_t* ctx) {
+  struct cr_dispatch_t* vk = &ctx->vk;
+
+  const char* missing = NULL;
+  CR_VK_INSTANCE_FUNCS(_LOAD_INSTANCE)
+  if(missing) {
+    CR_ERROR(ctx->log, "Failed to load instance Vulkan function %s.", missing);
+    return false;
+  }
+  CR_VK_INSTANCE_OPTIONAL_FUNCS(_LOAD_INSTANCE_OPTIONAL)
+
+  return true;
+}
+
+bool
+cr_dispatch_load_device(struct cr_context_t* ctx) {
+  struct cr_dispatch_t* vk = &ctx->vk;
+
+  const char* missing = NULL;
+  CR_VK_DEVICE_FUNCS(_LOAD_DEVICE)
+  if(missing) {
+    CR_ERROR(ctx->log, "Failed to load device Vulkan function %s.", missing);
+    return false;
+  }
+  CR_VK_DEVICE_OPTIONAL_FUNCS(_LOAD_DEVICE_OPTIONAL)
+
+  if(ctx->features.draw_indirect_count && !vk->CmdDrawIndexedIndirectCount) {
+    CR_WARN(ctx->log, "vkCmdDrawIndexedIndirectCount is unavailable, disabling draw indirect count.");
+    ctx->features.draw_indirect_count = false;
+  }
+  if(ctx->features.external_memory_host && !vk->GetMemoryHostPointerPropertiesEXT) {
+    CR_WARN(ctx->log, "vkGetMemoryHostPointerPropertiesEXT is unavailable, disabling external memory host.");
+    ctx->features.external_memory_host = false;
+  }
+
+  CR_TRACE(ctx->log, "Loaded Vulkan device functions (swapchain: %s)",
+           vk->QueuePresentKHR ? "true" : "false");
+  return true;
+}
+
+void
+cr_dispatch_unload(struct cr_context_t* ctx) {
+  if(ctx->vk.loader) dlclose(ctx->vk.loader);
+  memset(&ctx->vk, 0, sizeof ctx->vk);
+}
@@ -0,0 +1,318 @@
+#include "../include/corender/draw.h"
+#include "../include/corender/capture.h"
+#include "../include/corender/util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "DRAW"
+
+static uint32_t _cull(struct cr_draw_list_t* list, uint32_t frame_idx, VkDeviceSize region, VkRect2D rect);
+static VkDeviceSize _region_size(const struct cr_draw_list_t* list);
+static void     _write_object(struct cr_draw_list_t* list, uint32_t id, const struct cr_draw_object_t* obj);
+static void     _capture_object(
+  struct cr_draw_list_t* list, enum cr_capture_record_type_t type, uint32_t id, const struct cr_draw_object_t* obj);
+
+void
+_capture_object(
+  struct cr_draw_list_t* list, enum cr_capture_record_type_t type, uint32_t id, const struct cr_draw_object_t* obj) {
+  struct cr_capture_draw_object_t* rec = cr_capture_record(
+    list->capture, type, sizeof *rec + (obj ? sizeof *obj : 0));
+  if(!rec) return;
+
+  rec->draw_list = list->capture_id;
+  rec->id = id;
+  if(obj) memcpy(rec + 1, obj, sizeof *obj);
+}
+
+VkDeviceSize
+_region_size(const struct cr_draw_list_t* list) {
+  return CR_DRAW_LIST_CMD_OFFSET + (VkDeviceSize)list->capacity * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+uint32_t
+_cull(struct cr_draw_list_t* list, uint32_t frame_idx, VkDeviceSize region, VkRect2D rect) {
+  uint8_t* base = (uint8_t*)list->cmd_bufs[frame_idx].mapped + region;
+  VkDrawIndexedIndirectCommand* cmds = (VkDrawIndexedIndirectCommand*)(base + CR_DRAW_LIST_CMD_OFFSET);
+
+  // This frame's copy of the objects, no longer read by the GPU.
+  const uint32_t first_instance = frame_idx * list->capacity;
+  struct cr_draw_object_t* frame_objects = (struct cr_draw_object_t*)list->object_buf.mapped + first_instance;
+  const uint8_t frame_bit = 1u << frame_idx;
+
+  const float x0 = (float)rect.offset.x;
+  const float y0 = (float)rect.offset.y;
+  const float x1 = x0 + (float)rect.extent.width;
+  const float y1 = y0 + (float)rect.extent.height;
+
+  uint32_t n = 0;
+  for(uint32_t i = 0; i < list->n_objects; i++) {
+    const struct cr_draw_object_t* obj = &list->objects[i];
+    if(list->stale[i] & frame_bit) {
+      frame_objects[i] = *obj;
+      list->stale[i] &= ~frame_bit;
+    }
+
+    const uint32_t mask = CR_DRAW_OBJECT_ACTIVE | CR_DRAW_OBJECT_HIDDEN | CR_DRAW_OBJECT_OCCLUDED;
+    if((obj->flags & mask) != CR_DRAW_OBJECT_ACTIVE) continue;
+    if(obj->index_count == 0) continue;
+    if(obj->x >= x1 || obj->x + obj->w <= x0 ||
+       obj->y >= y1 || obj->y + obj->h <= y0) continue;
+
+    cmds[n++] = (VkDrawIndexedIndirectCommand){
+      .indexCount = obj->index_count,
+      .instanceCount = 1,
+      .firstIndex = obj->first_index,
+      .vertexOffset = obj->vertex_offset,
+      .firstInstance = first_instance + i
+    };
+  }
+
+  *(uint32_t*)base = n;
+  return n;
+}
+
+bool
+cr_draw_list_create(struct cr_context_t* ctx, struct cr_draw_list_t* o_list, uint32_t capacity) {
+  memset(o_list, 0, sizeof *o_list);
+  if(!ctx->features.draw_indirect_first_instance) {
+    CR_ERROR(ctx->log, "Draw lists require drawIndirectFirstInstance, which the device does not support.");
+    return false;
+  }
+  o_list->ctx = ctx;
+  o_list->capacity = capacity;
+  o_list->index_type = VK_INDEX_TYPE_UINT32;
+
+  o_list->objects = cr_host_calloc(ctx, capacity, sizeof(*o_list->objects));
+  o_list->free_ids = cr_host_calloc(ctx, capacity, sizeof(*o_list->free_ids));
+  o_list->retired = cr_host_calloc(ctx, capacity, sizeof(*o_list->retired));
+  o_list->stale = cr_host_calloc(ctx, capacity, sizeof(*o_list->stale));
+  if(!o_list->objects || !o_list->free_ids || !o_list->retired || !o_list->stale) {
+    CR_ERROR(ctx->log, "Failed to allocate draw list (capacity: %i)", capacity);
+    return false;
+  }
+
+  if(!cr_buffer_create_mapped(
+    ctx, &o_list->object_buf,
+    (VkDeviceSize)CR_FRAME_COUNT * capacity * sizeof(struct cr_draw_object_t),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+    CR_ERROR(ctx->log, "Failed to create draw list object buffer.");
+    return false;
+  }
+
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    if(!cr_buffer_create_mapped(
+      ctx, &o_list->cmd_bufs[i],
+      CR_MAX_OUTPUTS * _region_size(o_list),
+      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)) {
+      CR_ERROR(ctx->log, "Failed to create draw list indirect buffer for frame %i.", i);
+      return false;
+    }
+  }
+
+  if(ctx->capture) {
+    o_list->capture = ctx->capture;
+    o_list->capture_id = ++ctx->capture->next_draw_list;
+
+    struct cr_capture_draw_list_t* rec = cr_capture_record(
+      o_list->capture, CR_CAPTURE_RECORD_DRAW_LIST_CREATE, sizeof *rec);
+    if(rec) {
+      rec->draw_list = o_list->capture_id;
+      rec->capacity = capacity;
+    }
+  }
+
+  CR_TRACE(ctx->log, "Initialized draw list (capacity: %i, draw indirect count: %s)",
+           capacity, ctx->features.draw_indirect_count ? "true" : "false");
+
+  return true;
+}
+
+void
+cr_draw_list_destroy(struct cr_context_t* ctx, struct cr_draw_list_t* list) {
+  struct cr_capture_draw_list_t* rec = cr_capture_record(
+    list->capture, CR_CAPTURE_RECORD_DRAW_LIST_DESTROY, sizeof *rec);
+  if(rec) {
+    rec->draw_list = list->capture_id;
+    rec->capacity = list->capacity;
+  }
+
+  if(list->occlusion) {
+    cr_occlusion_destroy(list->occlusion);
+    cr_host_free(ctx, list->occlusion);
+  }
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    cr_buffer_destroy(ctx, &list->cmd_bufs[i]);
+  }
+  cr_buffer_destroy(ctx, &list->object_buf);
+  cr_host_free(ctx, list->objects);
+  cr_host_free(ctx, list->free_ids);
+  cr_host_free(ctx, list->retired);
+  cr_host_free(ctx, list->stale);
+  memset(list, 0, sizeof *list);
+}
+
+bool
+cr_draw_list_enable_occlusion(struct cr_context_t* ctx, struct cr_draw_list_t* list, VkExtent2D extent) {
+  if(list->occlusion) return true;
+
+  struct cr_occlusion_t* occ = cr_host_alloc(ctx, sizeof *occ);
+  if(!occ) {
+    CR_ERROR(ctx->log, "Failed to allocate draw list occlusion.");
+    return false;
+  }
+  if(!cr_occlusion_init(ctx, occ, list->capacity, extent)) {
+    cr_occlusion_destroy(occ);
+    cr_host_free(ctx, occ);
+    return false;
+  }
+  for(uint32_t i = 0; i < list->n_objects; i++) {
+    if(list->objects[i].flags & CR_DRAW_OBJECT_ACTIVE) cr_occlusion_move(occ, i, NULL, &list->objects[i]);
+  }
+  list->occlusion = occ;
+  return true;
+}
+
+uint32_t
+cr_draw_list_add(struct cr_draw_list_t* list, const struct cr_draw_object_t* obj) {
+  // Ids removed in frames the GPU has finished become reusable.
+  while(list->n_retired > 0 &&
+        list->retired[list->retired_head].frame_no <= list->ctx->frameloop.completed_no) {
+    list->free_ids[list->n_free++] = list->retired[list->retired_head].id;
+    list->retired_head = (list->retired_head + 1) % list->capacity;
+    list->n_retired--;
+  }
+
+  uint32_t id;
+  if(list->n_free > 0) {
+    id = list->free_ids[--list->n_free];
+  } else if(list->n_objects < list->capacity) {
+    id = list->n_objects++;
+  } else {
+    return CR_DRAW_OBJECT_INVALID;
+  }
+
+  _capture_object(list, CR_CAPTURE_RECORD_DRAW_OBJECT_ADD, id, obj);
+  _write_object(list, id, obj);
+  return id;
+}
+
+void
+cr_draw_list_update(struct cr_draw_list_t* list, uint32_t id, const struct cr_draw_object_t* obj) {
+  // Removed ids wait in `retired` or `free_ids` and must not come back.
+  if(id >= list->n_objects || !(list->objects[id].flags & CR_DRAW_OBJECT_ACTIVE)) return;
+
+  _capture_object(list, CR_CAPTURE_RECORD_DRAW_OBJECT_UPDATE, id, obj);
+  _write_object(list, id, obj);
+}
+
+void
+_write_object(struct cr_draw_list_t* list, uint32_t id, const struct cr_draw_object_t* obj) {
+  struct cr_draw_object_t* dst = &list->objects[id];
+  if(list->occlusion) {
+    cr_occlusion_move(list->occlusion, id, (dst->flags & CR_DRAW_OBJECT_ACTIVE) ? dst : NULL, obj);
+  }
+  *dst = *obj;
+  dst->flags = (dst->flags | CR_DRAW_OBJECT_ACTIVE) & ~CR_DRAW_OBJECT_OCCLUDED;
+  // Visibility is resolved at record time; until then the object is whole.
+  dst->clip_x = obj->x;
+  dst->clip_y = obj->y;
+  dst->clip_w = obj->w;
+  dst->clip_h = obj->h;
+
+  // The object buffer is persistent: only touched objects are copied, by
+  // each frame as it is recorded.
+  list->stale[id] = CR_DRAW_LIST_ALL_FRAMES;
+}
+
+void
+cr_draw_list_remove(struct cr_draw_list_t* list, uint32_t id) {
+  if(id >= list->n_objects || !(list->objects[id].flags & CR_DRAW_OBJECT_ACTIVE)) return;
+
+  _capture_object(list, CR_CAPTURE_RECORD_DRAW_OBJECT_REMOVE, id, NULL);
+  if(list->occlusion) cr_occlusion_move(list->occlusion, id, &list->objects[id], NULL);
+  list->objects[id].flags = 0;
+  list->stale[id] = CR_DRAW_LIST_ALL_FRAMES;
+
+  const uint32_t slot = (list->retired_head + list->n_retired++) % list->capacity;
+  list->retired[slot] = (struct cr_draw_retired_id_t){
+    .id = id,
+    .frame_no = list->ctx->frameloop.frame_no + 1
+  };
+}
+
+void
+cr_draw_list_bind(
+  struct cr_draw_list_t* list,
+  VkPipeline pipeline,
+  VkPipelineLayout layout,
+  VkDescriptorSet set,
+  VkBuffer vertex_buf,
+  VkBuffer index_buf,
+  VkIndexType index_type) {
+  list->pipeline = pipeline;
+  list->layout = layout;
+  list->set = set;
+  list->vertex_buf = vertex_buf;
+  list->index_buf = index_buf;
+  list->index_type = index_type;
+}
+
+bool
+cr_draw_list_record(
+  struct cr_context_t* ctx,
+  struct cr_draw_list_t* list,
+  VkCommandBuffer cmd,
+  uint32_t frame_idx,
+  VkRect2D rect) {
+  if(list->record_no != ctx->frameloop.frame_no) {
+    list->record_no = ctx->frameloop.frame_no;
+    list->n_records = 0;
+  }
+  if(list->n_records == CR_MAX_OUTPUTS) {
+    CR_ERROR(ctx->log, "Draw list recorded more than %i times in one frame.", CR_MAX_OUTPUTS);
+    return false;
+  }
+  const VkDeviceSize region = (VkDeviceSize)list->n_records++ * _region_size(list);
+
+  if(list->occlusion) cr_occlusion_update(list->occlusion, list);
+  list->n_visible = _cull(list, frame_idx, region, rect);
+  if(!list->pipeline || !list->index_buf || list->n_visible == 0) return true;
+
+  VkViewport viewport = {
+    .x = (float)rect.offset.x,
+    .y = (float)rect.offset.y,
+    .width = (float)rect.extent.width,
+    .height = (float)rect.extent.height,
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f
+  };
+
+  ctx->vk.CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, list->pipeline);
+  ctx->vk.CmdSetViewport(cmd, 0, 1, &viewport);
+  ctx->vk.CmdSetScissor(cmd, 0, 1, &rect);
+  if(list->set) {
+    ctx->vk.CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, list->layout, 0, 1, &list->set, 0, NULL);
+  }
+  if(list->vertex_buf) {
+    VkDeviceSize offset = 0;
+    ctx->vk.CmdBindVertexBuffers(cmd, 0, 1, &list->vertex_buf, &offset);
+  }
+  ctx->vk.CmdBindIndexBuffer(cmd, list->index_buf, 0, list->index_type);
+
+  VkBuffer cmd_buf = list->cmd_bufs[frame_idx].handle;
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+  if(ctx->features.draw_indirect_count) {
+    ctx->vk.CmdDrawIndexedIndirectCount(
+      cmd, cmd_buf, region + CR_DRAW_LIST_CMD_OFFSET, cmd_buf, region, list->capacity, stride);
+  } else if(ctx->features.multi_draw_indirect) {
+    ctx->vk.CmdDrawIndexedIndirect(cmd, cmd_buf, region + CR_DRAW_LIST_CMD_OFFSET, list->n_visible, stride);
+  } else {
+    for(uint32_t i = 0; i < list->n_visible; i++) {
+      ctx->vk.CmdDrawIndexedIndirect(cmd, cmd_buf, region + CR_DRAW_LIST_CMD_OFFSET + (VkDeviceSize)i * stride, 1, stride);
+    }
+  }
+
+  return true;
+}
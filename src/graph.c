@@ -0,0 +1,720 @@
+#include "../include/corender/graph.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "GRAPH"
+
+#define _WRITE_ACCESS (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+                       VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |                            \
+                       VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+struct _access_state_t {
+  VkImageLayout layout;
+  VkAccessFlags access;
+  VkPipelineStageFlags stage;
+  VkImageUsageFlags usage;
+};
+
+static bool  _is_depth(VkFormat fmt);
+static bool  _is_write(enum cr_graph_access_t access);
+static bool  _is_attachment(enum cr_graph_access_t access);
+static VkImageAspectFlags     _aspect(VkFormat fmt);
+static struct _access_state_t _access_state(enum cr_graph_access_t access);
+
+static void  _cull(struct cr_graph_t* graph);
+static void  _resolve_lifetimes(struct cr_graph_t* graph);
+static bool  _create_images(struct cr_context_t* ctx, struct cr_graph_t* graph);
+static bool  _create_render_pass(struct cr_context_t* ctx, struct cr_graph_t* graph, uint32_t pass_idx);
+static VkFramebuffer _framebuffer(struct cr_context_t* ctx, struct cr_graph_t* graph, struct cr_graph_pass_t* pass);
+static void  _retire_compiled(struct cr_context_t* ctx, struct cr_graph_t* graph);
+
+bool
+_is_depth(VkFormat fmt) {
+  switch(fmt) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+VkImageAspectFlags
+_aspect(VkFormat fmt) {
+  switch(fmt) {
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return _is_depth(fmt) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+bool
+_is_write(enum cr_graph_access_t access) {
+  return access == CR_GRAPH_ACCESS_COLOR_WRITE ||
+    access == CR_GRAPH_ACCESS_DEPTH_WRITE ||
+    access == CR_GRAPH_ACCESS_TRANSFER_DST;
+}
+
+bool
+_is_attachment(enum cr_graph_access_t access) {
+  return access == CR_GRAPH_ACCESS_COLOR_WRITE || access == CR_GRAPH_ACCESS_DEPTH_WRITE;
+}
+
+struct _access_state_t
+_access_state(enum cr_graph_access_t access) {
+  switch(access) {
+    case CR_GRAPH_ACCESS_COLOR_WRITE:
+      return (struct _access_state_t){
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+      };
+    case CR_GRAPH_ACCESS_DEPTH_WRITE:
+      return (struct _access_state_t){
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+      };
+    case CR_GRAPH_ACCESS_SAMPLED:
+      return (struct _access_state_t){
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_IMAGE_USAGE_SAMPLED_BIT
+      };
+    case CR_GRAPH_ACCESS_TRANSFER_SRC:
+      return (struct _access_state_t){
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+      };
+    case CR_GRAPH_ACCESS_TRANSFER_DST:
+    default:
+      return (struct _access_state_t){
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT
+      };
+  }
+}
+
+void
+_cull(struct cr_graph_t* graph) {
+  bool needed[CR_GRAPH_MAX_RESOURCES];
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    needed[r] = graph->resources[r].output || graph->resources[r].imported;
+  }
+
+  // Walk backwards: a pass lives if it writes something a live pass or
+  // an output still needs, and then everything it reads is needed.
+  graph->n_culled = 0;
+  for(uint32_t p = graph->n_passes; p-- > 0;) {
+    struct cr_graph_pass_t* pass = &graph->passes[p];
+
+    bool alive = pass->n_uses == 0;
+    for(uint32_t u = 0; u < pass->n_uses && !alive; u++) {
+      alive = _is_write(pass->uses[u].access) && needed[pass->uses[u].res];
+    }
+    pass->culled = !alive;
+    if(!alive) {
+      graph->n_culled++;
+      continue;
+    }
+
+    for(uint32_t u = 0; u < pass->n_uses; u++) {
+      const struct cr_graph_use_t* use = &pass->uses[u];
+      if(!_is_write(use->access)) {
+        needed[use->res] = true;
+      } else if(_is_attachment(use->access) && pass->clear) {
+        // Cleared attachments don't depend on earlier contents.
+        needed[use->res] = false;
+      }
+    }
+  }
+}
+
+void
+_resolve_lifetimes(struct cr_graph_t* graph) {
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    res->first_pass = res->last_pass = CR_GRAPH_NONE;
+    res->usage = 0;
+    res->block = CR_GRAPH_NONE;
+  }
+
+  for(uint32_t p = 0; p < graph->n_passes; p++) {
+    const struct cr_graph_pass_t* pass = &graph->passes[p];
+    if(pass->culled) continue;
+
+    for(uint32_t u = 0; u < pass->n_uses; u++) {
+      struct cr_graph_resource_t* res = &graph->resources[pass->uses[u].res];
+      if(res->first_pass == CR_GRAPH_NONE) res->first_pass = p;
+      res->last_pass = p;
+      res->usage |= _access_state(pass->uses[u].access).usage;
+    }
+  }
+}
+
+bool
+_create_images(struct cr_context_t* ctx, struct cr_graph_t* graph) {
+  VkMemoryRequirements reqs[CR_GRAPH_MAX_RESOURCES];
+  uint32_t order[CR_GRAPH_MAX_RESOURCES];
+  uint32_t n_order = 0;
+
+  graph->transient_size = 0;
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    if(res->imported || res->first_pass == CR_GRAPH_NONE) continue;
+
+    // Attachments living inside a single pass never reach memory on
+    // tilers; they get lazily allocated memory where the device has it.
+    const VkImageUsageFlags attachment_usage =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    const bool lazy = res->first_pass == res->last_pass && !(res->usage & ~attachment_usage);
+    if(lazy) res->usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+    VkImageCreateInfo img_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = res->fmt,
+      .extent = { res->extent.width, res->extent.height, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = res->usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    _VK_CHECK(ctx, ctx->vk.CreateImage(ctx->logical_dev, &img_info, ctx->host.vk_alloc, &res->image));
+    ctx->vk.GetImageMemoryRequirements(ctx->logical_dev, res->image, &reqs[r]);
+    graph->transient_size += reqs[r].size;
+
+    uint32_t lazy_type;
+    if(lazy && cr_memory_find_type(ctx, reqs[r].memoryTypeBits,
+                                   VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &lazy_type)) {
+      struct cr_graph_block_t* block = &graph->blocks[graph->n_blocks];
+      *block = (struct cr_graph_block_t){
+        .size = reqs[r].size,
+        .align = reqs[r].alignment,
+        .type_bits = reqs[r].memoryTypeBits & (1u << lazy_type),
+        .lazy = true
+      };
+      res->block = graph->n_blocks++;
+      continue;
+    }
+    order[n_order++] = r;
+  }
+
+  // Largest first, each image goes into the first block whose images
+  // are all dead before it is first used (or born after its last use).
+  for(uint32_t i = 1; i < n_order; i++) {
+    uint32_t r = order[i], j = i;
+    for(; j > 0 && reqs[order[j - 1]].size < reqs[r].size; j--) order[j] = order[j - 1];
+    order[j] = r;
+  }
+  for(uint32_t i = 0; i < n_order; i++) {
+    struct cr_graph_resource_t* res = &graph->resources[order[i]];
+    const VkMemoryRequirements* req = &reqs[order[i]];
+
+    uint32_t b = 0;
+    for(; b < graph->n_blocks; b++) {
+      struct cr_graph_block_t* block = &graph->blocks[b];
+      if(block->lazy || !(block->type_bits & req->memoryTypeBits)) continue;
+
+      bool overlaps = false;
+      for(uint32_t k = 0; k < i && !overlaps; k++) {
+        const struct cr_graph_resource_t* other = &graph->resources[order[k]];
+        overlaps = other->block == b &&
+          other->first_pass <= res->last_pass && res->first_pass <= other->last_pass;
+      }
+      if(!overlaps) break;
+    }
+
+    struct cr_graph_block_t* block = &graph->blocks[b];
+    if(b == graph->n_blocks) {
+      *block = (struct cr_graph_block_t){ .type_bits = req->memoryTypeBits };
+      graph->n_blocks++;
+    }
+    block->size = req->size > block->size ? req->size : block->size;
+    block->align = req->alignment > block->align ? req->alignment : block->align;
+    block->type_bits &= req->memoryTypeBits;
+    res->block = b;
+  }
+
+  graph->aliased_size = 0;
+  for(uint32_t b = 0; b < graph->n_blocks; b++) {
+    struct cr_graph_block_t* block = &graph->blocks[b];
+    VkMemoryRequirements block_reqs = {
+      .size = block->size,
+      .alignment = block->align,
+      .memoryTypeBits = block->type_bits
+    };
+    const VkMemoryPropertyFlags props = block->lazy ?
+      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if(!cr_memory_alloc(ctx, &block_reqs, props, &block->mem, &block->type)) {
+      CR_ERROR(ctx->log, "Failed to allocate transient memory block %i (size: %lu)", b, (unsigned long)block->size);
+      return false;
+    }
+    if(!block->lazy) graph->aliased_size += block->size;
+  }
+
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    if(res->imported || res->first_pass == CR_GRAPH_NONE) continue;
+
+    _VK_CHECK(ctx, ctx->vk.BindImageMemory(ctx->logical_dev, res->image, graph->blocks[res->block].mem, 0));
+
+    VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = res->image,
+      .format = res->fmt,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .subresourceRange = {
+        .aspectMask = _aspect(res->fmt),
+        .levelCount = 1,
+        .layerCount = 1
+      }
+    };
+    _VK_CHECK(ctx, ctx->vk.CreateImageView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &res->view));
+  }
+
+  return true;
+}
+
+bool
+_create_render_pass(struct cr_context_t* ctx, struct cr_graph_t* graph, uint32_t pass_idx) {
+  struct cr_graph_pass_t* pass = &graph->passes[pass_idx];
+  VkAttachmentDescription descs[CR_GRAPH_MAX_ATTACHMENTS];
+  VkAttachmentReference colors[CR_GRAPH_MAX_ATTACHMENTS];
+  VkAttachmentReference depth;
+  uint32_t n_colors = 0;
+  bool has_depth = false;
+
+  pass->n_attachments = 0;
+  for(uint32_t u = 0; u < pass->n_uses; u++) {
+    const struct cr_graph_use_t* use = &pass->uses[u];
+    if(!_is_attachment(use->access)) continue;
+    if(pass->n_attachments == CR_GRAPH_MAX_ATTACHMENTS) {
+      CR_ERROR(ctx->log, "Pass '%s' has too many attachments (max: %i)", pass->name, CR_GRAPH_MAX_ATTACHMENTS);
+      return false;
+    }
+
+    const struct cr_graph_resource_t* res = &graph->resources[use->res];
+    const VkImageLayout layout = _access_state(use->access).layout;
+    // Earlier contents only matter when something wrote them; later
+    // contents only when something reads them after this pass.
+    const bool fresh = res->first_pass == pass_idx &&
+      (!res->imported || res->initial_layout == VK_IMAGE_LAYOUT_UNDEFINED);
+    const bool keep = res->imported || res->output || res->last_pass > pass_idx;
+    const VkAttachmentLoadOp load = pass->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR :
+      fresh ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD;
+    const VkAttachmentStoreOp store = keep ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    const uint32_t a = pass->n_attachments++;
+    pass->attachments[a] = use->res;
+    descs[a] = (VkAttachmentDescription){
+      .format = res->fmt,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = load,
+      .storeOp = store,
+      .stencilLoadOp = load,
+      .stencilStoreOp = store,
+      // Transitions happen in the graph's barriers, outside the pass.
+      .initialLayout = layout,
+      .finalLayout = layout
+    };
+
+    if(use->access == CR_GRAPH_ACCESS_DEPTH_WRITE) {
+      depth = (VkAttachmentReference){ .attachment = a, .layout = layout };
+      has_depth = true;
+    } else {
+      colors[n_colors++] = (VkAttachmentReference){ .attachment = a, .layout = layout };
+    }
+
+    if(a == 0) pass->extent = res->extent;
+  }
+  if(pass->n_attachments == 0) return true;
+
+  VkSubpassDescription subpass_desc = {
+    .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+    .colorAttachmentCount = n_colors,
+    .pColorAttachments = colors,
+    .pDepthStencilAttachment = has_depth ? &depth : NULL
+  };
+
+  VkRenderPassCreateInfo pass_info = {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+    .attachmentCount = pass->n_attachments,
+    .pAttachments = descs,
+    .subpassCount = 1,
+    .pSubpasses = &subpass_desc
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateRenderPass(ctx->logical_dev, &pass_info, ctx->host.vk_alloc, &pass->render_pass));
+
+  return true;
+}
+
+VkFramebuffer
+_framebuffer(struct cr_context_t* ctx, struct cr_graph_t* graph, struct cr_graph_pass_t* pass) {
+  VkImageView views[CR_GRAPH_MAX_ATTACHMENTS] = {0};
+  for(uint32_t a = 0; a < pass->n_attachments; a++) {
+    views[a] = graph->resources[pass->attachments[a]].view;
+  }
+
+  for(uint32_t i = 0; i < pass->n_fbs; i++) {
+    if(memcmp(pass->fb_views[i], views, sizeof views) == 0) return pass->fbs[i];
+  }
+  if(pass->n_fbs == CR_GRAPH_MAX_FRAMEBUFFERS) {
+    CR_ERROR(ctx->log, "Pass '%s' ran out of cached framebuffers (max: %i)", pass->name, CR_GRAPH_MAX_FRAMEBUFFERS);
+    return VK_NULL_HANDLE;
+  }
+
+  VkFramebufferCreateInfo fb_info = {
+    .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+    .renderPass = pass->render_pass,
+    .attachmentCount = pass->n_attachments,
+    .pAttachments = views,
+    .width = pass->extent.width,
+    .height = pass->extent.height,
+    .layers = 1
+  };
+  VkFramebuffer fb;
+  if(ctx->vk.CreateFramebuffer(ctx->logical_dev, &fb_info, ctx->host.vk_alloc, &fb) != VK_SUCCESS) {
+    CR_ERROR(ctx->log, "Failed to create framebuffer for pass '%s'", pass->name);
+    return VK_NULL_HANDLE;
+  }
+
+  memcpy(pass->fb_views[pass->n_fbs], views, sizeof views);
+  pass->fbs[pass->n_fbs++] = fb;
+  return fb;
+}
+
+void
+_retire_compiled(struct cr_context_t* ctx, struct cr_graph_t* graph) {
+  // Retired rather than destroyed, so graphs can be rebuilt (e.g. after a
+  // resize) while earlier frames still use them.
+  for(uint32_t p = 0; p < graph->n_passes; p++) {
+    struct cr_graph_pass_t* pass = &graph->passes[p];
+    for(uint32_t i = 0; i < pass->n_fbs; i++) {
+      cr_deletion_push(ctx, CR_DELETION_FRAMEBUFFER, (union cr_deletion_handle_t){ .framebuffer = pass->fbs[i] });
+    }
+    pass->n_fbs = 0;
+    if(pass->render_pass) {
+      cr_deletion_push(ctx, CR_DELETION_RENDER_PASS, (union cr_deletion_handle_t){ .render_pass = pass->render_pass });
+      pass->render_pass = VK_NULL_HANDLE;
+    }
+  }
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    if(res->imported) continue;
+    if(res->view) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE_VIEW, (union cr_deletion_handle_t){ .image_view = res->view });
+      res->view = VK_NULL_HANDLE;
+    }
+    if(res->image) {
+      cr_deletion_push(ctx, CR_DELETION_IMAGE, (union cr_deletion_handle_t){ .image = res->image });
+      res->image = VK_NULL_HANDLE;
+    }
+  }
+  for(uint32_t b = 0; b < graph->n_blocks; b++) {
+    const struct cr_graph_block_t* block = &graph->blocks[b];
+    if(!block->mem) continue;
+    union cr_deletion_handle_t h = { .memory = { block->mem, block->size, block->type } };
+    cr_deletion_push(ctx, CR_DELETION_MEMORY, h);
+  }
+  graph->n_blocks = 0;
+  graph->compiled = false;
+}
+
+void
+cr_graph_init(struct cr_graph_t* o_graph) {
+  memset(o_graph, 0, sizeof *o_graph);
+}
+
+uint32_t
+cr_graph_create_image(struct cr_graph_t* graph, const char* name, VkFormat fmt, VkExtent2D extent) {
+  if(graph->n_resources == CR_GRAPH_MAX_RESOURCES) return CR_GRAPH_NONE;
+
+  graph->resources[graph->n_resources] = (struct cr_graph_resource_t){
+    .name = name,
+    .fmt = fmt,
+    .extent = extent
+  };
+  graph->compiled = false;
+  return graph->n_resources++;
+}
+
+uint32_t
+cr_graph_import_image(
+  struct cr_graph_t* graph,
+  const char* name,
+  VkFormat fmt,
+  VkExtent2D extent,
+  VkImageLayout initial_layout,
+  VkImageLayout final_layout) {
+  const uint32_t res = cr_graph_create_image(graph, name, fmt, extent);
+  if(res == CR_GRAPH_NONE) return res;
+
+  graph->resources[res].imported = true;
+  graph->resources[res].initial_layout = initial_layout;
+  graph->resources[res].final_layout = final_layout;
+  return res;
+}
+
+void
+cr_graph_set_image(struct cr_graph_t* graph, uint32_t res, VkImage image, VkImageView view) {
+  if(res >= graph->n_resources || !graph->resources[res].imported) return;
+  graph->resources[res].image = image;
+  graph->resources[res].view = view;
+}
+
+void
+cr_graph_mark_output(struct cr_graph_t* graph, uint32_t res) {
+  if(res >= graph->n_resources) return;
+  graph->resources[res].output = true;
+  graph->compiled = false;
+}
+
+uint32_t
+cr_graph_add_pass(struct cr_graph_t* graph, const char* name, cr_graph_exec_func_t exec, void* userdata) {
+  if(graph->n_passes == CR_GRAPH_MAX_PASSES) return CR_GRAPH_NONE;
+
+  graph->passes[graph->n_passes] = (struct cr_graph_pass_t){
+    .name = name,
+    .exec = exec,
+    .userdata = userdata
+  };
+  graph->compiled = false;
+  return graph->n_passes++;
+}
+
+bool
+cr_graph_pass_use(struct cr_graph_t* graph, uint32_t pass, uint32_t res, enum cr_graph_access_t access) {
+  if(pass >= graph->n_passes || res >= graph->n_resources) return false;
+
+  struct cr_graph_pass_t* p = &graph->passes[pass];
+  if(p->n_uses == CR_GRAPH_MAX_USES) return false;
+  p->uses[p->n_uses++] = (struct cr_graph_use_t){ .res = res, .access = access };
+  graph->compiled = false;
+  return true;
+}
+
+void
+cr_graph_pass_clear(struct cr_graph_t* graph, uint32_t pass, VkClearColorValue color) {
+  if(pass >= graph->n_passes) return;
+  graph->passes[pass].clear = true;
+  graph->passes[pass].clear_color = color;
+  graph->compiled = false;
+}
+
+bool
+cr_graph_compile(struct cr_context_t* ctx, struct cr_graph_t* graph) {
+  // Recompiling after the graph changed starts from fresh images, memory
+  // and render passes.
+  _retire_compiled(ctx, graph);
+
+  _cull(graph);
+  _resolve_lifetimes(graph);
+
+  if(!_create_images(ctx, graph)) {
+    CR_ERROR(ctx->log, "Failed to create transient images.");
+    return false;
+  }
+
+  for(uint32_t p = 0; p < graph->n_passes; p++) {
+    if(graph->passes[p].culled) continue;
+    if(!_create_render_pass(ctx, graph, p)) {
+      CR_ERROR(ctx->log, "Failed to create render pass for pass '%s'", graph->passes[p].name);
+      return false;
+    }
+  }
+
+  for(uint32_t b = 0; b < graph->n_blocks; b++) {
+    graph->blocks[b].access = 0;
+    graph->blocks[b].stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  }
+  graph->compiled = true;
+
+  CR_TRACE(ctx->log, "Compiled render graph (passes: %i, culled: %i, resources: %i, "
+           "transient memory: %lu, after aliasing: %lu)",
+           graph->n_passes, graph->n_culled, graph->n_resources,
+           (unsigned long)graph->transient_size, (unsigned long)graph->aliased_size);
+
+  return true;
+}
+
+bool
+cr_graph_execute(struct cr_context_t* ctx, struct cr_graph_t* graph, VkCommandBuffer cmd) {
+  if(!graph->compiled) {
+    CR_ERROR(ctx->log, "Render graph must be compiled before it is executed.");
+    return false;
+  }
+
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    res->layout = res->imported ? res->initial_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    res->access = 0;
+    // Imported images may come from a semaphore wait at any stage.
+    res->stage = res->imported ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : 0;
+  }
+  // Blocks keep the state of the previous execution: transient images are
+  // shared by every frame in flight, so their first use must also wait
+  // for the last use in the frame submitted before.
+  graph->n_barriers = 0;
+
+  for(uint32_t p = 0; p < graph->n_passes; p++) {
+    struct cr_graph_pass_t* pass = &graph->passes[p];
+    if(pass->culled) continue;
+
+    VkImageMemoryBarrier barriers[CR_GRAPH_MAX_USES];
+    uint32_t n_barriers = 0;
+    VkPipelineStageFlags src_stage = 0, dst_stage = 0;
+
+    for(uint32_t u = 0; u < pass->n_uses; u++) {
+      struct cr_graph_resource_t* res = &graph->resources[pass->uses[u].res];
+      if(!res->image) {
+        CR_ERROR(ctx->log, "Resource '%s' used by pass '%s' has no image.", res->name, pass->name);
+        return false;
+      }
+      const struct _access_state_t state = _access_state(pass->uses[u].access);
+
+      // The first use of an aliased image must wait for whatever used
+      // its memory before, and may discard the contents.
+      const bool first = !res->imported && res->first_pass == p;
+      if(first) {
+        res->access = graph->blocks[res->block].access;
+        res->stage = graph->blocks[res->block].stage;
+      }
+
+      const bool hazard = (res->access & _WRITE_ACCESS) || (state.access & _WRITE_ACCESS);
+      if(first || hazard || res->layout != state.layout) {
+        barriers[n_barriers++] = (VkImageMemoryBarrier){
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = res->access,
+          .dstAccessMask = state.access,
+          .oldLayout = first ? VK_IMAGE_LAYOUT_UNDEFINED : res->layout,
+          .newLayout = state.layout,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = res->image,
+          .subresourceRange = {
+            .aspectMask = _aspect(res->fmt),
+            .levelCount = 1,
+            .layerCount = 1
+          }
+        };
+        src_stage |= res->stage ? res->stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        dst_stage |= state.stage;
+
+        res->layout = state.layout;
+        res->access = state.access;
+        res->stage = state.stage;
+      } else {
+        // Read after read in the same layout needs no barrier, but a later
+        // write has to wait for both readers.
+        res->access |= state.access;
+        res->stage |= state.stage;
+      }
+
+      if(!res->imported) {
+        graph->blocks[res->block].access = res->access;
+        graph->blocks[res->block].stage = res->stage;
+      }
+    }
+
+    if(n_barriers > 0) {
+      ctx->vk.CmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 0, NULL, 0, NULL, n_barriers, barriers);
+      graph->n_barriers += n_barriers;
+    }
+
+    if(!pass->render_pass) {
+      if(pass->exec && !pass->exec(ctx, cmd, pass, pass->userdata)) return false;
+      continue;
+    }
+
+    VkFramebuffer fb = _framebuffer(ctx, graph, pass);
+    if(!fb) return false;
+
+    VkClearValue clears[CR_GRAPH_MAX_ATTACHMENTS];
+    for(uint32_t a = 0; a < pass->n_attachments; a++) {
+      if(_is_depth(graph->resources[pass->attachments[a]].fmt)) {
+        clears[a].depthStencil = (VkClearDepthStencilValue){ .depth = 1.0f, .stencil = 0 };
+      } else {
+        clears[a].color = pass->clear_color;
+      }
+    }
+
+    VkRenderPassBeginInfo renderpass_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass = pass->render_pass,
+      .framebuffer = fb,
+      .renderArea = {
+        .offset = {0, 0},
+        .extent = pass->extent
+      },
+      .pClearValues = clears,
+      .clearValueCount = pass->clear ? pass->n_attachments : 0
+    };
+
+    ctx->vk.CmdBeginRenderPass(cmd, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+    bool ok = !pass->exec || pass->exec(ctx, cmd, pass, pass->userdata);
+    ctx->vk.CmdEndRenderPass(cmd);
+    if(!ok) return false;
+  }
+
+  // Hand imported images back in the layout their owner expects.
+  VkImageMemoryBarrier barriers[CR_GRAPH_MAX_RESOURCES];
+  uint32_t n_barriers = 0;
+  VkPipelineStageFlags src_stage = 0;
+  for(uint32_t r = 0; r < graph->n_resources; r++) {
+    struct cr_graph_resource_t* res = &graph->resources[r];
+    if(!res->imported || !res->image || res->final_layout == VK_IMAGE_LAYOUT_UNDEFINED ||
+       res->layout == res->final_layout) continue;
+
+    barriers[n_barriers++] = (VkImageMemoryBarrier){
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = res->access & _WRITE_ACCESS,
+      .dstAccessMask = 0,
+      .oldLayout = res->layout,
+      .newLayout = res->final_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = res->image,
+      .subresourceRange = {
+        .aspectMask = _aspect(res->fmt),
+        .levelCount = 1,
+        .layerCount = 1
+      }
+    };
+    src_stage |= res->stage;
+    res->layout = res->final_layout;
+  }
+  if(n_barriers > 0) {
+    ctx->vk.CmdPipelineBarrier(cmd, src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                               0, 0, NULL, 0, NULL, n_barriers, barriers);
+    graph->n_barriers += n_barriers;
+  }
+
+  return true;
+}
+
+void
+cr_graph_destroy(struct cr_context_t* ctx, struct cr_graph_t* graph) {
+  _retire_compiled(ctx, graph);
+  memset(graph, 0, sizeof *graph);
+}
@@ -0,0 +1,341 @@
+#include "../include/corender/host.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "HOST"
+
+// Scope of allocations corender makes for itself.
+#define _SCOPE_CORENDER UINT32_MAX
+#define _MIN_ALIGN 16
+#define _ARENA_BLOCK_SIZE (16u << 10)
+#define _SCRATCH_BLOCK_SIZE (64u << 10)
+
+// Precedes every tracked allocation, so frees (which carry no size in
+// VkAllocationCallbacks) can be accounted and realigned.
+struct _header_t {
+  void* raw;
+  size_t size;
+  uint32_t scope;
+  uint32_t align;
+};
+
+struct cr_arena_block_t {
+  struct cr_arena_block_t* next;
+  size_t size, used;
+};
+
+static void* _default_alloc(size_t size, void* userdata);
+static void  _default_free(void* ptr, void* userdata);
+static struct _header_t* _header(void* ptr);
+static struct cr_host_alloc_stats_t* _stats(struct cr_host_t* host, uint32_t scope);
+static void* _alloc(struct cr_host_t* host, size_t size, size_t align, uint32_t scope, bool realloc);
+static void  _free(struct cr_host_t* host, void* ptr, bool realloc);
+static void* _realloc(struct cr_host_t* host, void* ptr, size_t size, size_t align, uint32_t scope);
+static void  _report(struct cr_context_t* ctx, const char* name, const struct cr_host_alloc_stats_t* stats);
+
+static VKAPI_ATTR void* VKAPI_CALL _vk_alloc(
+  void* userdata, size_t size, size_t align, VkSystemAllocationScope scope);
+static VKAPI_ATTR void* VKAPI_CALL _vk_realloc(
+  void* userdata, void* orig, size_t size, size_t align, VkSystemAllocationScope scope);
+static VKAPI_ATTR void  VKAPI_CALL _vk_free(void* userdata, void* mem);
+static VKAPI_ATTR void  VKAPI_CALL _vk_internal_alloc(
+  void* userdata, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+static VKAPI_ATTR void  VKAPI_CALL _vk_internal_free(
+  void* userdata, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+void*
+_default_alloc(size_t size, void* userdata) {
+  (void)userdata;
+  return malloc(size);
+}
+
+void
+_default_free(void* ptr, void* userdata) {
+  (void)userdata;
+  free(ptr);
+}
+
+struct _header_t*
+_header(void* ptr) {
+  return (struct _header_t*)ptr - 1;
+}
+
+struct cr_host_alloc_stats_t*
+_stats(struct cr_host_t* host, uint32_t scope) {
+  if(scope == _SCOPE_CORENDER || scope > VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE) return &host->stats.corender;
+  return &host->stats.driver[scope];
+}
+
+void*
+_alloc(struct cr_host_t* host, size_t size, size_t align, uint32_t scope, bool realloc) {
+  if(align < _MIN_ALIGN) align = _MIN_ALIGN;
+
+  pthread_mutex_lock(&host->lock);
+  if(host->budget && host->stats.live_bytes + size > host->budget) {
+    host->stats.n_failed++;
+    pthread_mutex_unlock(&host->lock);
+    return NULL;
+  }
+  pthread_mutex_unlock(&host->lock);
+
+  uint8_t* raw = host->allocator.alloc(sizeof(struct _header_t) + align + size, host->allocator.userdata);
+  if(!raw) {
+    pthread_mutex_lock(&host->lock);
+    host->stats.n_failed++;
+    pthread_mutex_unlock(&host->lock);
+    return NULL;
+  }
+
+  uintptr_t addr = ((uintptr_t)raw + sizeof(struct _header_t) + align - 1) & ~(uintptr_t)(align - 1);
+  void* ptr = (void*)addr;
+  *_header(ptr) = (struct _header_t){ .raw = raw, .size = size, .scope = scope, .align = (uint32_t)align };
+
+  pthread_mutex_lock(&host->lock);
+  struct cr_host_alloc_stats_t* stats = _stats(host, scope);
+  if(realloc) stats->n_reallocs++;
+  else stats->n_allocs++;
+  stats->live_allocs++;
+  stats->live_bytes += size;
+  if(stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+  host->stats.live_bytes += size;
+  if(host->stats.live_bytes > host->stats.peak_bytes) host->stats.peak_bytes = host->stats.live_bytes;
+  pthread_mutex_unlock(&host->lock);
+
+  return ptr;
+}
+
+void
+_free(struct cr_host_t* host, void* ptr, bool realloc) {
+  if(!ptr) return;
+  const struct _header_t header = *_header(ptr);
+
+  pthread_mutex_lock(&host->lock);
+  struct cr_host_alloc_stats_t* stats = _stats(host, header.scope);
+  if(!realloc) stats->n_frees++;
+  stats->live_allocs--;
+  stats->live_bytes -= header.size;
+  host->stats.live_bytes -= header.size;
+  pthread_mutex_unlock(&host->lock);
+
+  host->allocator.free(header.raw, host->allocator.userdata);
+}
+
+void*
+_realloc(struct cr_host_t* host, void* ptr, size_t size, size_t align, uint32_t scope) {
+  if(!ptr) return _alloc(host, size, align, scope, false);
+  if(size == 0) {
+    _free(host, ptr, false);
+    return NULL;
+  }
+
+  const struct _header_t* header = _header(ptr);
+  if(align < header->align) align = header->align;
+  // Original stays valid when the new allocation fails.
+  void* new_ptr = _alloc(host, size, align, scope, true);
+  if(!new_ptr) return NULL;
+  memcpy(new_ptr, ptr, header->size < size ? header->size : size);
+  _free(host, ptr, true);
+  return new_ptr;
+}
+
+VKAPI_ATTR void* VKAPI_CALL
+_vk_alloc(void* userdata, size_t size, size_t align, VkSystemAllocationScope scope) {
+  struct cr_context_t* ctx = userdata;
+  return _alloc(&ctx->host, size, align, scope, false);
+}
+
+VKAPI_ATTR void* VKAPI_CALL
+_vk_realloc(void* userdata, void* orig, size_t size, size_t align, VkSystemAllocationScope scope) {
+  struct cr_context_t* ctx = userdata;
+  return _realloc(&ctx->host, orig, size, align, scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+_vk_free(void* userdata, void* mem) {
+  struct cr_context_t* ctx = userdata;
+  _free(&ctx->host, mem, false);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+_vk_internal_alloc(void* userdata, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+  (void)type; (void)scope;
+  struct cr_context_t* ctx = userdata;
+  pthread_mutex_lock(&ctx->host.lock);
+  ctx->host.stats.driver_internal_bytes += size;
+  pthread_mutex_unlock(&ctx->host.lock);
+}
+
+VKAPI_ATTR void VKAPI_CALL
+_vk_internal_free(void* userdata, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+  (void)type; (void)scope;
+  struct cr_context_t* ctx = userdata;
+  pthread_mutex_lock(&ctx->host.lock);
+  ctx->host.stats.driver_internal_bytes -= size;
+  pthread_mutex_unlock(&ctx->host.lock);
+}
+
+void
+_report(struct cr_context_t* ctx, const char* name, const struct cr_host_alloc_stats_t* stats) {
+  if(stats->live_allocs == 0) return;
+  CR_WARN(ctx->log, "%s still holds %lu host allocations (%lu bytes) at teardown.",
+          name, (unsigned long)stats->live_allocs, (unsigned long)stats->live_bytes);
+}
+
+bool
+cr_host_init(struct cr_context_t* ctx, const struct cr_host_info_t* info) {
+  struct cr_host_t* host = &ctx->host;
+  memset(host, 0, sizeof *host);
+
+  if(info && info->allocator.alloc && info->allocator.free) {
+    host->allocator = info->allocator;
+  } else {
+    host->allocator = (struct cr_allocator_t){ .alloc = _default_alloc, .free = _default_free };
+  }
+  host->budget = info ? info->budget : 0;
+
+  if(pthread_mutex_init(&host->lock, NULL) != 0) {
+    CR_ERROR(ctx->log, "Failed to create host allocation lock.");
+    return false;
+  }
+
+  host->vk = (VkAllocationCallbacks){
+    .pUserData = ctx,
+    .pfnAllocation = _vk_alloc,
+    .pfnReallocation = _vk_realloc,
+    .pfnFree = _vk_free,
+    .pfnInternalAllocation = _vk_internal_alloc,
+    .pfnInternalFree = _vk_internal_free
+  };
+  host->vk_alloc = &host->vk;
+
+  cr_arena_init(ctx, &host->arena, _ARENA_BLOCK_SIZE);
+  host->initialized = true;
+
+  CR_TRACE(ctx->log, "Initialized host allocation tracking (custom allocator: %s, budget: %lu)",
+           host->allocator.alloc == _default_alloc ? "false" : "true", (unsigned long)host->budget);
+
+  return true;
+}
+
+void
+cr_host_destroy(struct cr_context_t* ctx) {
+  struct cr_host_t* host = &ctx->host;
+  if(!host->initialized) return;
+
+  cr_arena_destroy(&host->arena);
+
+  CR_TRACE(ctx->log, "Host memory peak: %lu bytes (corender: %lu, failed allocations: %lu)",
+           (unsigned long)host->stats.peak_bytes, (unsigned long)host->stats.corender.peak_bytes,
+           (unsigned long)host->stats.n_failed);
+
+  _report(ctx, "corender", &host->stats.corender);
+  for(uint32_t i = 0; i <= VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE; i++) {
+    _report(ctx, "Driver", &host->stats.driver[i]);
+  }
+
+  pthread_mutex_destroy(&host->lock);
+  memset(host, 0, sizeof *host);
+}
+
+void*
+cr_host_alloc(struct cr_context_t* ctx, size_t size) {
+  return _alloc(&ctx->host, size, _MIN_ALIGN, _SCOPE_CORENDER, false);
+}
+
+void*
+cr_host_calloc(struct cr_context_t* ctx, size_t n, size_t size) {
+  if(size && n > SIZE_MAX / size) return NULL;
+  void* ptr = cr_host_alloc(ctx, n * size);
+  if(ptr) memset(ptr, 0, n * size);
+  return ptr;
+}
+
+void*
+cr_host_realloc(struct cr_context_t* ctx, void* ptr, size_t size) {
+  return _realloc(&ctx->host, ptr, size, _MIN_ALIGN, _SCOPE_CORENDER);
+}
+
+void
+cr_host_free(struct cr_context_t* ctx, void* ptr) {
+  _free(&ctx->host, ptr, false);
+}
+
+void
+cr_host_get_stats(struct cr_context_t* ctx, struct cr_host_stats_t* o_stats) {
+  pthread_mutex_lock(&ctx->host.lock);
+  *o_stats = ctx->host.stats;
+  pthread_mutex_unlock(&ctx->host.lock);
+}
+
+void
+cr_arena_init(struct cr_context_t* ctx, struct cr_arena_t* o_arena, size_t block_size) {
+  memset(o_arena, 0, sizeof *o_arena);
+  o_arena->ctx = ctx;
+  o_arena->block_size = block_size;
+}
+
+void*
+cr_arena_alloc(struct cr_arena_t* arena, size_t size, size_t align) {
+  if(align == 0) align = 1;
+
+  for(;;) {
+    struct cr_arena_block_t* block = arena->crnt;
+    if(block) {
+      const uintptr_t base = (uintptr_t)(block + 1);
+      const uintptr_t addr = (base + block->used + align - 1) & ~(uintptr_t)(align - 1);
+      if(addr + size <= base + block->size) {
+        block->used = addr + size - base;
+        arena->used += size;
+        if(arena->used > arena->peak) arena->peak = arena->used;
+        memset((void*)addr, 0, size);
+        return (void*)addr;
+      }
+      // Blocks kept by a reset are reused before new ones are allocated.
+      if(block->next) {
+        arena->crnt = block->next;
+        arena->crnt->used = 0;
+        continue;
+      }
+    }
+
+    size_t block_size = size + align > arena->block_size ? size + align : arena->block_size;
+    struct cr_arena_block_t* new_block = cr_host_alloc(arena->ctx, sizeof *new_block + block_size);
+    if(!new_block) return NULL;
+    *new_block = (struct cr_arena_block_t){ .size = block_size };
+
+    if(block) block->next = new_block;
+    else arena->head = new_block;
+    arena->crnt = new_block;
+    arena->reserved += block_size;
+  }
+}
+
+void
+cr_arena_reset(struct cr_arena_t* arena) {
+  arena->crnt = arena->head;
+  if(arena->crnt) arena->crnt->used = 0;
+  arena->used = 0;
+}
+
+void
+cr_arena_destroy(struct cr_arena_t* arena) {
+  struct cr_arena_block_t* block = arena->head;
+  while(block) {
+    struct cr_arena_block_t* next = block->next;
+    cr_host_free(arena->ctx, block);
+    block = next;
+  }
+  struct cr_context_t* ctx = arena->ctx;
+  size_t block_size = arena->block_size;
+  cr_arena_init(ctx, arena, block_size);
+}
+
+void*
+cr_frame_scratch_alloc(struct cr_context_t* ctx, size_t size, size_t align) {
+  struct cr_arena_t* scratch = &ctx->frameloop.frames[ctx->frameloop.frame_idx].scratch;
+  if(!scratch->ctx) cr_arena_init(ctx, scratch, _SCRATCH_BLOCK_SIZE);
+  return cr_arena_alloc(scratch, size, align);
+}
@@ -0,0 +1,372 @@
+#include "../include/corender/memory.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "MEMORY"
+
+// Share of a heap assumed to be available to us without VK_EXT_memory_budget.
+#define _MEMORY_BUDGET_ESTIMATE 0.8
+
+// Largest mapped buffer placed in device-local host-visible memory. Without
+// resizable BAR that heap is typically 256 MiB, shared with the driver.
+#define _MEMORY_BAR_MAX_SIZE (1024 * 1024)
+
+static void _set_pressure(struct cr_context_t* ctx, uint32_t heap, enum cr_memory_pressure_t pressure);
+static void _evaluate_pressure(struct cr_context_t* ctx, uint32_t heap);
+static void _track(struct cr_context_t* ctx, uint32_t type, VkDeviceSize size, bool alloc);
+static void _reclaim(struct cr_context_t* ctx);
+static bool _buffer_create(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags props,
+  VkMemoryPropertyFlags fallback_props);
+
+void
+_set_pressure(struct cr_context_t* ctx, uint32_t heap, enum cr_memory_pressure_t pressure) {
+  struct cr_memory_heap_stats_t* stats = &ctx->memory.stats.heaps[heap];
+  stats->pressure = pressure;
+
+  if(pressure != CR_MEMORY_PRESSURE_NONE) {
+    CR_WARN(ctx->log, "Memory pressure on heap %i: %s (usage: %lu, budget: %lu, own: %lu)",
+            heap, pressure == CR_MEMORY_PRESSURE_CRITICAL ? "critical" : "warn",
+            (unsigned long)stats->usage, (unsigned long)stats->budget, (unsigned long)stats->own);
+  }
+  if(ctx->memory.pressure.callback) {
+    ctx->memory.pressure.callback(ctx, heap, pressure, stats, ctx->memory.pressure.userdata);
+  }
+}
+
+void
+_evaluate_pressure(struct cr_context_t* ctx, uint32_t heap) {
+  const struct cr_memory_heap_stats_t* stats = &ctx->memory.stats.heaps[heap];
+  if(stats->budget == 0) return;
+
+  const double ratio = (double)stats->usage / (double)stats->budget;
+  enum cr_memory_pressure_t pressure = CR_MEMORY_PRESSURE_NONE;
+  if(ratio >= ctx->memory.pressure.critical_threshold) {
+    pressure = CR_MEMORY_PRESSURE_CRITICAL;
+  } else if(ratio >= ctx->memory.pressure.warn_threshold) {
+    pressure = CR_MEMORY_PRESSURE_WARN;
+  }
+
+  if(pressure != stats->pressure) {
+    _set_pressure(ctx, heap, pressure);
+  }
+}
+
+void
+_track(struct cr_context_t* ctx, uint32_t type, VkDeviceSize size, bool alloc) {
+  const uint32_t heap = ctx->mem_props.memoryTypes[type].heapIndex;
+  struct cr_memory_heap_stats_t* stats = &ctx->memory.stats.heaps[heap];
+
+  // Driver-reported usage is refreshed once per frame; keep it current in
+  // between so thresholds trip on the allocation that crosses them.
+  if(alloc) {
+    stats->own += size;
+    stats->usage += size;
+    stats->n_allocs++;
+  } else {
+    stats->own -= size;
+    stats->usage = stats->usage > size ? stats->usage - size : 0;
+    stats->n_allocs--;
+  }
+  _evaluate_pressure(ctx, heap);
+}
+
+bool
+cr_memory_init(struct cr_context_t* ctx, const struct cr_memory_pressure_info_t* pressure) {
+  struct cr_memory_t* mem = &ctx->memory;
+  memset(mem, 0, sizeof *mem);
+
+  if(pressure) mem->pressure = *pressure;
+  if(mem->pressure.warn_threshold <= 0.0f) mem->pressure.warn_threshold = 0.8f;
+  if(mem->pressure.critical_threshold <= 0.0f) mem->pressure.critical_threshold = 0.95f;
+  if(mem->pressure.critical_threshold < mem->pressure.warn_threshold) {
+    mem->pressure.critical_threshold = mem->pressure.warn_threshold;
+  }
+
+  mem->stats.n_heaps = ctx->mem_props.memoryHeapCount;
+  mem->stats.budget_ext = ctx->features.memory_budget;
+  for(uint32_t i = 0; i < mem->stats.n_heaps; i++) {
+    mem->stats.heaps[i].size = ctx->mem_props.memoryHeaps[i].size;
+    mem->stats.heaps[i].device_local =
+      ctx->mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  }
+  cr_memory_update_budget(ctx);
+
+  CR_TRACE(ctx->log, "Initialized memory tracking (heaps: %i, memory budget: %s, warn: %.2f, critical: %.2f)",
+           mem->stats.n_heaps, mem->stats.budget_ext ? "true" : "false",
+           mem->pressure.warn_threshold, mem->pressure.critical_threshold);
+
+  return true;
+}
+
+void
+cr_memory_update_budget(struct cr_context_t* ctx) {
+  struct cr_memory_stats_t* stats = &ctx->memory.stats;
+
+  if(stats->budget_ext) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
+    };
+    VkPhysicalDeviceMemoryProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = &budget
+    };
+    ctx->vk.GetPhysicalDeviceMemoryProperties2(ctx->phys_dev, &props);
+
+    for(uint32_t i = 0; i < stats->n_heaps; i++) {
+      stats->heaps[i].budget = budget.heapBudget[i];
+      stats->heaps[i].usage = budget.heapUsage[i];
+    }
+  } else {
+    for(uint32_t i = 0; i < stats->n_heaps; i++) {
+      stats->heaps[i].budget = (VkDeviceSize)(stats->heaps[i].size * _MEMORY_BUDGET_ESTIMATE);
+      stats->heaps[i].usage = stats->heaps[i].own;
+    }
+  }
+
+  for(uint32_t i = 0; i < stats->n_heaps; i++) {
+    _evaluate_pressure(ctx, i);
+  }
+}
+
+void
+cr_memory_get_stats(struct cr_context_t* ctx, struct cr_memory_stats_t* o_stats) {
+  *o_stats = ctx->memory.stats;
+}
+
+bool
+cr_memory_alloc(
+  struct cr_context_t* ctx,
+  const VkMemoryRequirements* reqs,
+  VkMemoryPropertyFlags props,
+  VkDeviceMemory* o_mem,
+  uint32_t* o_type) {
+  return cr_memory_alloc_chained(ctx, reqs, props, NULL, o_mem, o_type);
+}
+
+bool
+cr_memory_alloc_chained(
+  struct cr_context_t* ctx,
+  const VkMemoryRequirements* reqs,
+  VkMemoryPropertyFlags props,
+  const void* next,
+  VkDeviceMemory* o_mem,
+  uint32_t* o_type) {
+  uint32_t type;
+  if(!cr_memory_find_type(ctx, reqs->memoryTypeBits, props, &type)) {
+    CR_ERROR(ctx->log, "No memory type matches allocation (size: %lu, properties: 0x%x)",
+             (unsigned long)reqs->size, props);
+    return false;
+  }
+
+  VkMemoryAllocateInfo alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext = next,
+    .allocationSize = reqs->size,
+    .memoryTypeIndex = type
+  };
+  VkResult res = ctx->vk.AllocateMemory(ctx->logical_dev, &alloc_info, ctx->host.vk_alloc, o_mem);
+  if(res == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+    const uint32_t heap = ctx->mem_props.memoryTypes[type].heapIndex;
+    cr_memory_update_budget(ctx);
+    _set_pressure(ctx, heap, CR_MEMORY_PRESSURE_CRITICAL);
+    _reclaim(ctx);
+    res = ctx->vk.AllocateMemory(ctx->logical_dev, &alloc_info, ctx->host.vk_alloc, o_mem);
+  }
+  if(res != VK_SUCCESS) {
+    CR_ERROR(ctx->log, "Failed to allocate device memory: %s (size: %lu, memory type: %i)",
+             cr_util_vk_result_to_string(res), (unsigned long)reqs->size, type);
+    *o_mem = VK_NULL_HANDLE;
+    return false;
+  }
+
+  _track(ctx, type, reqs->size, true);
+  if(o_type) *o_type = type;
+  return true;
+}
+
+void
+cr_memory_free(struct cr_context_t* ctx, VkDeviceMemory mem, VkDeviceSize size, uint32_t type) {
+  if(!mem) return;
+  ctx->vk.FreeMemory(ctx->logical_dev, mem, ctx->host.vk_alloc);
+  _track(ctx, type, size, false);
+}
+
+bool
+cr_memory_find_type(
+  struct cr_context_t* ctx,
+  uint32_t type_bits,
+  VkMemoryPropertyFlags props,
+  uint32_t* o_type) {
+  const VkPhysicalDeviceMemoryProperties* mem_props = &ctx->mem_props;
+  for(uint32_t i = 0; i < mem_props->memoryTypeCount; i++) {
+    if(!(type_bits & (1u << i))) continue;
+    if((mem_props->memoryTypes[i].propertyFlags & props) != props) continue;
+    *o_type = i;
+    return true;
+  }
+  return false;
+}
+
+void
+_reclaim(struct cr_context_t* ctx) {
+  // Waits for every submitted frame and frees what was retired up to the
+  // last submission. Objects retired while building the current frame,
+  // including pressure callback evictions, may be referenced by commands
+  // already recorded and stay queued until that frame completes.
+  struct cr_frameloop_t* frameloop = &ctx->frameloop;
+  VkFence fences[CR_FRAME_COUNT];
+  uint32_t n_fences = 0;
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) {
+    struct cr_frame_t* frame = &frameloop->frames[i];
+    if(frame->submitted_no > frameloop->completed_no) fences[n_fences++] = frame->in_flight_fence;
+  }
+  if(n_fences > 0 &&
+     ctx->vk.WaitForFences(ctx->logical_dev, n_fences, fences, VK_TRUE, UINT64_MAX) == VK_SUCCESS) {
+    frameloop->completed_no = frameloop->frame_no;
+  }
+  cr_deletion_flush(ctx, frameloop->completed_no);
+}
+
+bool
+_buffer_create(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags props,
+  VkMemoryPropertyFlags fallback_props) {
+  memset(o_buf, 0, sizeof *o_buf);
+
+  VkBufferCreateInfo buf_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = size,
+    .usage = usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateBuffer(ctx->logical_dev, &buf_info, ctx->host.vk_alloc, &o_buf->handle));
+
+  VkMemoryRequirements reqs;
+  ctx->vk.GetBufferMemoryRequirements(ctx->logical_dev, o_buf->handle, &reqs);
+
+  // The preferred properties are only tried when a type allowed for this
+  // buffer has them and its heap still has room.
+  uint32_t type;
+  bool allocated = false;
+  if(fallback_props && cr_memory_find_type(ctx, reqs.memoryTypeBits, props, &type)) {
+    const struct cr_memory_heap_stats_t* heap =
+      &ctx->memory.stats.heaps[ctx->mem_props.memoryTypes[type].heapIndex];
+    if(heap->usage + reqs.size <= heap->budget) {
+      allocated = cr_memory_alloc(ctx, &reqs, props, &o_buf->mem, &type);
+    }
+  }
+  if(fallback_props && !allocated) props = fallback_props;
+  if(!allocated && !cr_memory_alloc(ctx, &reqs, props, &o_buf->mem, &type)) {
+    ctx->vk.DestroyBuffer(ctx->logical_dev, o_buf->handle, ctx->host.vk_alloc);
+    o_buf->handle = VK_NULL_HANDLE;
+    return false;
+  }
+  o_buf->mem_size = reqs.size;
+  o_buf->mem_type = type;
+  VkResult res = ctx->vk.BindBufferMemory(ctx->logical_dev, o_buf->handle, o_buf->mem, 0);
+  if(res == VK_SUCCESS && (props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+    res = ctx->vk.MapMemory(ctx->logical_dev, o_buf->mem, 0, VK_WHOLE_SIZE, 0, &o_buf->mapped);
+  }
+  if(res != VK_SUCCESS) {
+    CR_ERROR(ctx->log, "Failed to bind or map buffer memory: %s (size: %lu)",
+             cr_util_vk_result_to_string(res), (unsigned long)size);
+    o_buf->mapped = NULL;
+    cr_buffer_destroy(ctx, o_buf);
+    return false;
+  }
+
+  o_buf->size = size;
+
+  CR_TRACE(ctx->log, "Created buffer (size: %lu, usage: 0x%x, memory type: %i)",
+           (unsigned long)size, usage, type);
+
+  return true;
+}
+
+bool
+cr_buffer_create(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags props) {
+  return _buffer_create(ctx, o_buf, size, usage, props, 0);
+}
+
+bool
+cr_buffer_create_mapped(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage) {
+  const VkMemoryPropertyFlags host =
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  if(size > _MEMORY_BAR_MAX_SIZE) return cr_buffer_create_staging(ctx, o_buf, size, usage);
+  return _buffer_create(ctx, o_buf, size, usage, host | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, host);
+}
+
+bool
+cr_buffer_create_staging(
+  struct cr_context_t* ctx,
+  struct cr_buffer_t* o_buf,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage) {
+  return _buffer_create(ctx, o_buf, size, usage,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+}
+
+void
+cr_buffer_destroy(struct cr_context_t* ctx, struct cr_buffer_t* buf) {
+  if(buf->mapped) {
+    ctx->vk.UnmapMemory(ctx->logical_dev, buf->mem);
+  }
+  if(buf->handle) {
+    ctx->vk.DestroyBuffer(ctx->logical_dev, buf->handle, ctx->host.vk_alloc);
+  }
+  cr_memory_free(ctx, buf->mem, buf->mem_size, buf->mem_type);
+  memset(buf, 0, sizeof *buf);
+}
+
+void*
+cr_frame_upload_alloc(
+  struct cr_context_t* ctx,
+  VkDeviceSize size,
+  VkDeviceSize align,
+  VkBuffer* o_buf,
+  VkDeviceSize* o_offset) {
+  if(!cr_frame_begin(ctx)) return NULL;
+
+  struct cr_frame_t* frame = &ctx->frameloop.frames[ctx->frameloop.frame_idx];
+  if(align == 0) align = 1;
+
+  if(!frame->upload.handle && !cr_buffer_create_staging(
+    ctx, &frame->upload, CR_FRAME_UPLOAD_SIZE,
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+    CR_ERROR(ctx->log, "Failed to create upload buffer for frame %i", ctx->frameloop.frame_idx);
+    return NULL;
+  }
+
+  VkDeviceSize offset = (frame->upload_offset + align - 1) & ~(align - 1);
+  if(offset + size > frame->upload.size) {
+    CR_WARN(ctx->log, "Frame upload memory exhausted (requested: %lu, used: %lu, capacity: %lu)",
+            (unsigned long)size, (unsigned long)frame->upload_offset, (unsigned long)frame->upload.size);
+    return NULL;
+  }
+
+  frame->upload_offset = offset + size;
+  if(o_buf) *o_buf = frame->upload.handle;
+  if(o_offset) *o_offset = offset;
+  return (uint8_t*)frame->upload.mapped + offset;
+}
@@ -0,0 +1,298 @@
+#include "../include/corender/occlusion.h"
+#include "../include/corender/draw.h"
+#include "../include/corender/util.h"
+#include <math.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "OCCLUSION"
+
+struct _cell_range_t {
+  uint32_t c0, r0, c1, r1;
+};
+
+static struct cr_occlusion_rect_t _object_rect(const struct cr_draw_object_t* obj);
+static bool     _overlaps(const struct cr_occlusion_rect_t* a, const struct cr_occlusion_rect_t* b);
+static uint32_t _cell_clamp(float v, uint32_t cell_size, uint32_t n);
+static struct _cell_range_t _cells(const struct cr_occlusion_t* occ, const struct cr_occlusion_rect_t* rect);
+static bool     _cell_add(struct cr_occlusion_t* occ, struct cr_occlusion_cell_t* cell, uint32_t id);
+static void     _cell_remove(struct cr_occlusion_cell_t* cell, uint32_t id);
+static void     _mark_dirty(struct cr_occlusion_t* occ, const struct cr_occlusion_rect_t* rect);
+static uint32_t _subtract(struct cr_occlusion_rect_t* pieces, uint32_t n, const struct cr_occlusion_rect_t* r);
+static void     _resolve(struct cr_occlusion_t* occ, struct cr_draw_list_t* list, uint32_t id);
+
+struct cr_occlusion_rect_t
+_object_rect(const struct cr_draw_object_t* obj) {
+  return (struct cr_occlusion_rect_t){ obj->x, obj->y, obj->x + obj->w, obj->y + obj->h };
+}
+
+bool
+_overlaps(const struct cr_occlusion_rect_t* a, const struct cr_occlusion_rect_t* b) {
+  return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+uint32_t
+_cell_clamp(float v, uint32_t cell_size, uint32_t n) {
+  const float cell = floorf(v / (float)cell_size);
+  if(cell < 0.0f) return 0;
+  if(cell >= (float)n) return n - 1;
+  return (uint32_t)cell;
+}
+
+struct _cell_range_t
+_cells(const struct cr_occlusion_t* occ, const struct cr_occlusion_rect_t* rect) {
+  return (struct _cell_range_t){
+    .c0 = _cell_clamp(rect->x0, occ->cell_size, occ->n_cols),
+    .r0 = _cell_clamp(rect->y0, occ->cell_size, occ->n_rows),
+    .c1 = _cell_clamp(rect->x1, occ->cell_size, occ->n_cols),
+    .r1 = _cell_clamp(rect->y1, occ->cell_size, occ->n_rows)
+  };
+}
+
+bool
+_cell_add(struct cr_occlusion_t* occ, struct cr_occlusion_cell_t* cell, uint32_t id) {
+  if(cell->n == cell->cap) {
+    const uint32_t cap = cell->cap ? cell->cap * 2 : 8;
+    uint32_t* ids = cr_host_realloc(occ->ctx, cell->ids, cap * sizeof *ids);
+    if(!ids) return false;
+    cell->ids = ids;
+    cell->cap = cap;
+  }
+  cell->ids[cell->n++] = id;
+  return true;
+}
+
+void
+_cell_remove(struct cr_occlusion_cell_t* cell, uint32_t id) {
+  for(uint32_t i = 0; i < cell->n; i++) {
+    if(cell->ids[i] == id) {
+      cell->ids[i] = cell->ids[--cell->n];
+      return;
+    }
+  }
+}
+
+void
+_mark_dirty(struct cr_occlusion_t* occ, const struct cr_occlusion_rect_t* rect) {
+  if(occ->full) return;
+  if(occ->n_dirty == CR_OCCLUSION_MAX_DIRTY) {
+    occ->full = true;
+    return;
+  }
+  occ->dirty[occ->n_dirty++] = *rect;
+}
+
+uint32_t
+_subtract(struct cr_occlusion_rect_t* pieces, uint32_t n, const struct cr_occlusion_rect_t* r) {
+  struct cr_occlusion_rect_t out[CR_OCCLUSION_MAX_PIECES];
+  uint32_t n_out = 0;
+  for(uint32_t i = 0; i < n; i++) {
+    const struct cr_occlusion_rect_t* p = &pieces[i];
+    struct cr_occlusion_rect_t split[4];
+    uint32_t n_split = 0;
+    if(!_overlaps(p, r)) {
+      split[n_split++] = *p;
+    } else {
+      // Full-width bands above and below, then the sides in between.
+      const float y0 = p->y0 > r->y0 ? p->y0 : r->y0;
+      const float y1 = p->y1 < r->y1 ? p->y1 : r->y1;
+      if(p->y0 < r->y0) split[n_split++] = (struct cr_occlusion_rect_t){ p->x0, p->y0, p->x1, r->y0 };
+      if(p->y1 > r->y1) split[n_split++] = (struct cr_occlusion_rect_t){ p->x0, r->y1, p->x1, p->y1 };
+      if(p->x0 < r->x0) split[n_split++] = (struct cr_occlusion_rect_t){ p->x0, y0, r->x0, y1 };
+      if(p->x1 > r->x1) split[n_split++] = (struct cr_occlusion_rect_t){ r->x1, y0, p->x1, y1 };
+    }
+    // Too fragmented: leave the pieces as they were, which only ever
+    // overestimates what is visible.
+    if(n_out + n_split > CR_OCCLUSION_MAX_PIECES) return n;
+    memcpy(&out[n_out], split, n_split * sizeof *split);
+    n_out += n_split;
+  }
+  memcpy(pieces, out, n_out * sizeof *out);
+  return n_out;
+}
+
+void
+_resolve(struct cr_occlusion_t* occ, struct cr_draw_list_t* list, uint32_t id) {
+  struct cr_draw_object_t* obj = &list->objects[id];
+  const struct cr_occlusion_rect_t rect = _object_rect(obj);
+
+  struct cr_occlusion_rect_t pieces[CR_OCCLUSION_MAX_PIECES] = { rect };
+  uint32_t n = rect.x1 > rect.x0 && rect.y1 > rect.y0 ? 1 : 0;
+
+  if(++occ->test_stamp == 0) {
+    memset(occ->tested, 0, occ->capacity * sizeof *occ->tested);
+    occ->test_stamp = 1;
+  }
+  const struct _cell_range_t range = _cells(occ, &rect);
+  for(uint32_t r = range.r0; r <= range.r1 && n > 0; r++) {
+    for(uint32_t c = range.c0; c <= range.c1 && n > 0; c++) {
+      const struct cr_occlusion_cell_t* cell = &occ->cells[r * occ->n_cols + c];
+      for(uint32_t i = 0; i < cell->n && n > 0; i++) {
+        const uint32_t other_id = cell->ids[i];
+        if(other_id <= id || occ->tested[other_id] == occ->test_stamp) continue;
+        occ->tested[other_id] = occ->test_stamp;
+
+        const struct cr_draw_object_t* other = &list->objects[other_id];
+        const uint32_t mask = CR_DRAW_OBJECT_ACTIVE | CR_DRAW_OBJECT_HIDDEN | CR_DRAW_OBJECT_OPAQUE;
+        if((other->flags & mask) != (CR_DRAW_OBJECT_ACTIVE | CR_DRAW_OBJECT_OPAQUE)) continue;
+
+        const struct cr_occlusion_rect_t occluder = _object_rect(other);
+        n = _subtract(pieces, n, &occluder);
+      }
+    }
+  }
+
+  struct cr_occlusion_rect_t clip = rect;
+  if(n > 0) {
+    clip = pieces[0];
+    for(uint32_t i = 1; i < n; i++) {
+      if(pieces[i].x0 < clip.x0) clip.x0 = pieces[i].x0;
+      if(pieces[i].y0 < clip.y0) clip.y0 = pieces[i].y0;
+      if(pieces[i].x1 > clip.x1) clip.x1 = pieces[i].x1;
+      if(pieces[i].y1 > clip.y1) clip.y1 = pieces[i].y1;
+    }
+  }
+
+  const bool was_occluded = obj->flags & CR_DRAW_OBJECT_OCCLUDED;
+  const bool was_clipped = !was_occluded &&
+    (obj->clip_x != obj->x || obj->clip_y != obj->y || obj->clip_w != obj->w || obj->clip_h != obj->h);
+  const bool occluded = n == 0 && rect.x1 > rect.x0 && rect.y1 > rect.y0;
+  const bool clipped = !occluded &&
+    (clip.x0 != rect.x0 || clip.y0 != rect.y0 || clip.x1 != rect.x1 || clip.y1 != rect.y1);
+  occ->n_occluded += (uint32_t)occluded - (uint32_t)was_occluded;
+  occ->n_clipped += (uint32_t)clipped - (uint32_t)was_clipped;
+  occ->n_resolved++;
+
+  const uint32_t flags = occluded ? obj->flags | CR_DRAW_OBJECT_OCCLUDED : obj->flags & ~CR_DRAW_OBJECT_OCCLUDED;
+  const float clip_w = clip.x1 - clip.x0, clip_h = clip.y1 - clip.y0;
+  if(flags == obj->flags && clip.x0 == obj->clip_x && clip.y0 == obj->clip_y &&
+     clip_w == obj->clip_w && clip_h == obj->clip_h) {
+    return;
+  }
+  obj->flags = flags;
+  obj->clip_x = clip.x0;
+  obj->clip_y = clip.y0;
+  obj->clip_w = clip_w;
+  obj->clip_h = clip_h;
+  list->stale[id] = CR_DRAW_LIST_ALL_FRAMES;
+}
+
+bool
+cr_occlusion_init(
+  struct cr_context_t* ctx,
+  struct cr_occlusion_t* o_occ,
+  uint32_t capacity,
+  VkExtent2D extent) {
+  memset(o_occ, 0, sizeof *o_occ);
+  o_occ->ctx = ctx;
+  o_occ->capacity = capacity;
+  o_occ->cell_size = CR_OCCLUSION_CELL_SIZE;
+  o_occ->n_cols = (extent.width + CR_OCCLUSION_CELL_SIZE - 1) / CR_OCCLUSION_CELL_SIZE;
+  o_occ->n_rows = (extent.height + CR_OCCLUSION_CELL_SIZE - 1) / CR_OCCLUSION_CELL_SIZE;
+  if(o_occ->n_cols == 0) o_occ->n_cols = 1;
+  if(o_occ->n_rows == 0) o_occ->n_rows = 1;
+
+  o_occ->cells = cr_host_calloc(ctx, (size_t)o_occ->n_cols * o_occ->n_rows, sizeof *o_occ->cells);
+  o_occ->visited = cr_host_calloc(ctx, capacity, sizeof *o_occ->visited);
+  o_occ->tested = cr_host_calloc(ctx, capacity, sizeof *o_occ->tested);
+  if(!o_occ->cells || !o_occ->visited || !o_occ->tested) {
+    CR_ERROR(ctx->log, "Failed to allocate occlusion grid (%ix%i cells, capacity: %i)",
+             o_occ->n_cols, o_occ->n_rows, capacity);
+    return false;
+  }
+  o_occ->full = true;
+
+  CR_TRACE(ctx->log, "Initialized occlusion grid (%ix%i cells of %i pixels, capacity: %i)",
+           o_occ->n_cols, o_occ->n_rows, o_occ->cell_size, capacity);
+  return true;
+}
+
+void
+cr_occlusion_destroy(struct cr_occlusion_t* occ) {
+  struct cr_context_t* ctx = occ->ctx;
+  if(occ->cells) {
+    for(uint32_t i = 0; i < occ->n_cols * occ->n_rows; i++) {
+      cr_host_free(ctx, occ->cells[i].ids);
+    }
+  }
+  cr_host_free(ctx, occ->cells);
+  cr_host_free(ctx, occ->visited);
+  cr_host_free(ctx, occ->tested);
+  memset(occ, 0, sizeof *occ);
+}
+
+void
+cr_occlusion_move(
+  struct cr_occlusion_t* occ,
+  uint32_t id,
+  const struct cr_draw_object_t* prev,
+  const struct cr_draw_object_t* next) {
+  if(prev) {
+    // The rewritten object starts out whole, so drop it from the counts.
+    if(prev->flags & CR_DRAW_OBJECT_OCCLUDED) {
+      occ->n_occluded--;
+    } else if(prev->clip_x != prev->x || prev->clip_y != prev->y ||
+              prev->clip_w != prev->w || prev->clip_h != prev->h) {
+      occ->n_clipped--;
+    }
+    const struct cr_occlusion_rect_t rect = _object_rect(prev);
+    const struct _cell_range_t range = _cells(occ, &rect);
+    for(uint32_t r = range.r0; r <= range.r1; r++) {
+      for(uint32_t c = range.c0; c <= range.c1; c++) {
+        _cell_remove(&occ->cells[r * occ->n_cols + c], id);
+      }
+    }
+    _mark_dirty(occ, &rect);
+  }
+  if(next) {
+    const struct cr_occlusion_rect_t rect = _object_rect(next);
+    const struct _cell_range_t range = _cells(occ, &rect);
+    for(uint32_t r = range.r0; r <= range.r1; r++) {
+      for(uint32_t c = range.c0; c <= range.c1; c++) {
+        if(!_cell_add(occ, &occ->cells[r * occ->n_cols + c], id)) {
+          CR_ERROR(occ->ctx->log, "Failed to grow occlusion cell (%i, %i)", c, r);
+        }
+      }
+    }
+    _mark_dirty(occ, &rect);
+  }
+}
+
+void
+cr_occlusion_update(struct cr_occlusion_t* occ, struct cr_draw_list_t* list) {
+  if(occ->full) {
+    for(uint32_t i = 0; i < list->n_objects; i++) {
+      if(list->objects[i].flags & CR_DRAW_OBJECT_ACTIVE) _resolve(occ, list, i);
+    }
+    occ->full = false;
+    occ->n_dirty = 0;
+    return;
+  }
+  if(occ->n_dirty == 0) return;
+
+  // Only objects under a changed region can have changed visibility: a
+  // moved object affects what lies below its old and new rects, and its
+  // own new rect covers the object itself.
+  if(++occ->visit_stamp == 0) {
+    memset(occ->visited, 0, occ->capacity * sizeof *occ->visited);
+    occ->visit_stamp = 1;
+  }
+  for(uint32_t d = 0; d < occ->n_dirty; d++) {
+    const struct cr_occlusion_rect_t* dirty = &occ->dirty[d];
+    const struct _cell_range_t range = _cells(occ, dirty);
+    for(uint32_t r = range.r0; r <= range.r1; r++) {
+      for(uint32_t c = range.c0; c <= range.c1; c++) {
+        const struct cr_occlusion_cell_t* cell = &occ->cells[r * occ->n_cols + c];
+        for(uint32_t i = 0; i < cell->n; i++) {
+          const uint32_t id = cell->ids[i];
+          if(occ->visited[id] == occ->visit_stamp) continue;
+          const struct cr_occlusion_rect_t rect = _object_rect(&list->objects[id]);
+          if(!_overlaps(&rect, dirty)) continue;
+          occ->visited[id] = occ->visit_stamp;
+          _resolve(occ, list, id);
+        }
+      }
+    }
+  }
+  occ->n_dirty = 0;
+}
@@ -0,0 +1,161 @@
+#include "../include/corender/pipeline.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "PIPELINE"
+
+// VkPipelineCacheHeaderVersionOne, laid out as the spec defines it.
+struct _cache_header_t {
+  uint32_t length;
+  uint32_t version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint8_t uuid[VK_UUID_SIZE];
+};
+
+static bool  _default_path(char* o_path, size_t size);
+static void* _read_file(struct cr_context_t* ctx, const char* path, size_t* o_size);
+static bool  _header_matches(struct cr_context_t* ctx, const void* data, size_t size);
+
+bool
+_default_path(char* o_path, size_t size) {
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  char dir[512];
+  int n;
+  if(xdg && xdg[0]) {
+    n = snprintf(dir, sizeof dir, "%s/corender", xdg);
+  } else if(home && home[0]) {
+    n = snprintf(dir, sizeof dir, "%s/.cache/corender", home);
+  } else {
+    return false;
+  }
+  if(n < 0 || (size_t)n >= sizeof dir) return false;
+
+  // Only the last component is created; ~/.cache exists on any desktop.
+  if(mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+  n = snprintf(o_path, size, "%s/pipeline.cache", dir);
+  return n > 0 && (size_t)n < size;
+}
+
+void*
+_read_file(struct cr_context_t* ctx, const char* path, size_t* o_size) {
+  FILE* f = fopen(path, "rb");
+  if(!f) return NULL;
+
+  void* data = NULL;
+  long size = 0;
+  if(fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+    data = cr_host_alloc(ctx, (size_t)size);
+    if(data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+      cr_host_free(ctx, data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+
+  *o_size = data ? (size_t)size : 0;
+  return data;
+}
+
+bool
+_header_matches(struct cr_context_t* ctx, const void* data, size_t size) {
+  struct _cache_header_t header;
+  if(size < sizeof header) return false;
+  memcpy(&header, data, sizeof header);
+
+  VkPhysicalDeviceProperties props;
+  ctx->vk.GetPhysicalDeviceProperties(ctx->phys_dev, &props);
+
+  return header.length >= sizeof header &&
+    header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+    header.vendor_id == props.vendorID &&
+    header.device_id == props.deviceID &&
+    memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool
+cr_pipeline_cache_load(struct cr_context_t* ctx, struct cr_pipeline_cache_t* o_cache, const char* path) {
+  memset(o_cache, 0, sizeof *o_cache);
+  if(path) {
+    snprintf(o_cache->path, sizeof o_cache->path, "%s", path);
+  } else if(!_default_path(o_cache->path, sizeof o_cache->path)) {
+    CR_WARN(ctx->log, "No cache directory available, pipeline cache will not be persisted.");
+    o_cache->path[0] = '\0';
+  }
+
+  size_t size = 0;
+  void* data = o_cache->path[0] ? _read_file(ctx, o_cache->path, &size) : NULL;
+  if(data && !_header_matches(ctx, data, size)) {
+    CR_TRACE(ctx->log, "Discarding pipeline cache '%s' built for another device or driver.", o_cache->path);
+    cr_host_free(ctx, data);
+    data = NULL;
+    size = 0;
+  }
+
+  VkPipelineCacheCreateInfo cache_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    .initialDataSize = size,
+    .pInitialData = data
+  };
+  VkResult res = ctx->vk.CreatePipelineCache(ctx->logical_dev, &cache_info, ctx->host.vk_alloc, &o_cache->handle);
+  cr_host_free(ctx, data);
+  _VK_CHECK(ctx, res);
+
+  o_cache->loaded_size = size;
+
+  CR_TRACE(ctx->log, "Initialized pipeline cache (path: '%s', loaded: %lu bytes)",
+           o_cache->path, (unsigned long)size);
+
+  return true;
+}
+
+bool
+cr_pipeline_cache_save(struct cr_context_t* ctx, struct cr_pipeline_cache_t* cache) {
+  if(!cache->handle || !cache->path[0]) return true;
+
+  size_t size = 0;
+  _VK_CHECK(ctx, ctx->vk.GetPipelineCacheData(ctx->logical_dev, cache->handle, &size, NULL));
+  if(size == 0 || size == cache->loaded_size) return true;
+
+  void* data = cr_host_alloc(ctx, size);
+  if(!data) return false;
+  VkResult res = ctx->vk.GetPipelineCacheData(ctx->logical_dev, cache->handle, &size, data);
+  if(res != VK_SUCCESS) {
+    cr_host_free(ctx, data);
+    _VK_CHECK(ctx, res);
+  }
+
+  // Write to a temporary file and rename, so a crash never leaves a
+  // truncated cache behind.
+  char tmp[sizeof cache->path + 8];
+  snprintf(tmp, sizeof tmp, "%s.tmp", cache->path);
+  FILE* f = fopen(tmp, "wb");
+  bool ok = f && fwrite(data, 1, size, f) == size;
+  if(f) ok = fclose(f) == 0 && ok;
+  ok = ok && rename(tmp, cache->path) == 0;
+  cr_host_free(ctx, data);
+
+  if(!ok) {
+    CR_WARN(ctx->log, "Failed to write pipeline cache '%s': %s", cache->path, strerror(errno));
+    remove(tmp);
+    return false;
+  }
+
+  CR_TRACE(ctx->log, "Saved pipeline cache (path: '%s', size: %lu bytes)", cache->path, (unsigned long)size);
+  return true;
+}
+
+void
+cr_pipeline_cache_destroy(struct cr_context_t* ctx, struct cr_pipeline_cache_t* cache) {
+  if(cache->handle) {
+    ctx->vk.DestroyPipelineCache(ctx->logical_dev, cache->handle, ctx->host.vk_alloc);
+  }
+  memset(cache, 0, sizeof *cache);
+}
@@ -0,0 +1,255 @@
+#include "../include/corender/readback.h"
+#include "../include/corender/capture.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "READBACK"
+
+static bool _slot_done(struct cr_context_t* ctx, const struct cr_readback_slot_t* slot);
+static bool _slot_fit(struct cr_context_t* ctx, struct cr_readback_slot_t* slot, VkExtent2D extent);
+
+bool
+_slot_done(struct cr_context_t* ctx, const struct cr_readback_slot_t* slot) {
+  if(slot->frame_no <= ctx->frameloop.completed_no) return true;
+
+  const struct cr_frame_t* frame = &ctx->frameloop.frames[slot->frame_idx];
+  return frame->submitted_no == slot->frame_no &&
+    ctx->vk.GetFenceStatus(ctx->logical_dev, frame->in_flight_fence) == VK_SUCCESS;
+}
+
+bool
+_slot_fit(struct cr_context_t* ctx, struct cr_readback_slot_t* slot, VkExtent2D extent) {
+  const VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+  if(slot->buf.size >= size) return true;
+
+  // The output grew since the slot was created; earlier frames may still
+  // copy into the old buffer.
+  cr_deletion_push_buffer(ctx, &slot->buf);
+  if(!cr_buffer_create(ctx, &slot->buf, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, ctx->readback.props)) {
+    CR_ERROR(ctx->log, "Failed to recreate readback buffer (width: %i, height: %i)", extent.width, extent.height);
+    return false;
+  }
+  CR_TRACE(ctx->log, "Recreated readback buffer (width: %i, height: %i)", extent.width, extent.height);
+  return true;
+}
+
+bool
+cr_readback_init(struct cr_context_t* ctx) {
+  struct cr_readback_t* rb = &ctx->readback;
+  if(rb->initialized) return true;
+
+  if(!(ctx->outputs[0].swapchain.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+    CR_ERROR(ctx->log, "Swapchain images cannot be used as transfer source, readback unavailable.");
+    return false;
+  }
+
+  // Cached memory makes CPU reads of the captured pixels fast; it may need
+  // explicit invalidation when it is not coherent.
+  const VkMemoryPropertyFlags candidates[] = {
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+  };
+  VkMemoryPropertyFlags props = candidates[2];
+  for(uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    uint32_t type;
+    if(cr_memory_find_type(ctx, UINT32_MAX, candidates[i], &type)) {
+      props = candidates[i];
+      break;
+    }
+  }
+  rb->coherent = props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  rb->props = props;
+
+  const uint32_t w = ctx->outputs[0].swapchain.dimensions.width;
+  const uint32_t h = ctx->outputs[0].swapchain.dimensions.height;
+  for(uint32_t i = 0; i < CR_READBACK_RING_SIZE; i++) {
+    struct cr_readback_slot_t* slot = &rb->slots[i];
+    if(!cr_buffer_create(ctx, &slot->buf, (VkDeviceSize)w * h * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, props)) {
+      CR_ERROR(ctx->log, "Failed to create readback buffer for slot %i", i);
+      return false;
+    }
+    slot->state = CR_READBACK_SLOT_FREE;
+  }
+
+  rb->next = 0;
+  rb->initialized = true;
+
+  CR_TRACE(ctx->log, "Initialized readback ring (slots: %i, width: %i, height: %i, coherent: %s)",
+           CR_READBACK_RING_SIZE, w, h, rb->coherent ? "true" : "false");
+
+  return true;
+}
+
+void
+cr_readback_destroy(struct cr_context_t* ctx) {
+  struct cr_readback_t* rb = &ctx->readback;
+  for(uint32_t i = 0; i < CR_READBACK_RING_SIZE; i++) {
+    cr_buffer_destroy(ctx, &rb->slots[i].buf);
+  }
+  memset(rb, 0, sizeof *rb);
+}
+
+void
+cr_readback_invalidate(struct cr_context_t* ctx) {
+  struct cr_readback_t* rb = &ctx->readback;
+  if(!rb->initialized) return;
+
+  // Pending and acquired slots are still in use; they are refitted when
+  // they are next picked.
+  for(uint32_t i = 0; i < CR_READBACK_RING_SIZE; i++) {
+    if(rb->slots[i].state == CR_READBACK_SLOT_FREE) cr_deletion_push_buffer(ctx, &rb->slots[i].buf);
+  }
+}
+
+void
+cr_readback_request(struct cr_context_t* ctx, bool continuous) {
+  uint32_t* rec = cr_capture_record(ctx->capture, CR_CAPTURE_RECORD_READBACK_REQUEST, sizeof *rec);
+  if(rec) *rec = continuous;
+
+  ctx->readback.requested = true;
+  ctx->readback.continuous = continuous;
+}
+
+bool
+cr_readback_acquire(struct cr_context_t* ctx, struct cr_readback_image_t* o_img) {
+  struct cr_readback_t* rb = &ctx->readback;
+  if(!rb->initialized) return false;
+
+  struct cr_readback_slot_t* oldest = NULL;
+  uint32_t oldest_idx = 0;
+  for(uint32_t i = 0; i < CR_READBACK_RING_SIZE; i++) {
+    struct cr_readback_slot_t* slot = &rb->slots[i];
+    if(slot->state == CR_READBACK_SLOT_PENDING && _slot_done(ctx, slot)) {
+      slot->state = CR_READBACK_SLOT_READY;
+    }
+    if(slot->state == CR_READBACK_SLOT_READY && (!oldest || slot->frame_no < oldest->frame_no)) {
+      oldest = slot;
+      oldest_idx = i;
+    }
+  }
+  if(!oldest) return false;
+
+  if(!rb->coherent) {
+    VkMappedMemoryRange range = {
+      .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+      .memory = oldest->buf.mem,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    };
+    ctx->vk.InvalidateMappedMemoryRanges(ctx->logical_dev, 1, &range);
+  }
+
+  oldest->state = CR_READBACK_SLOT_ACQUIRED;
+  *o_img = (struct cr_readback_image_t){
+    .pixels = oldest->buf.mapped,
+    .width = oldest->width,
+    .height = oldest->height,
+    .stride = oldest->width * 4,
+    .fmt = ctx->outputs[0].swapchain.fmt,
+    .frame_no = oldest->frame_no,
+    .slot = oldest_idx
+  };
+  return true;
+}
+
+void
+cr_readback_release(struct cr_context_t* ctx, const struct cr_readback_image_t* img) {
+  if(img->slot >= CR_READBACK_RING_SIZE) return;
+  struct cr_readback_slot_t* slot = &ctx->readback.slots[img->slot];
+  if(slot->state == CR_READBACK_SLOT_ACQUIRED) {
+    slot->state = CR_READBACK_SLOT_FREE;
+  }
+}
+
+bool
+cr_readback_record(
+  struct cr_context_t* ctx,
+  VkCommandBuffer cmd,
+  VkImage image,
+  uint32_t frame_idx) {
+  struct cr_readback_t* rb = &ctx->readback;
+  if(!rb->requested) return true;
+  if(!rb->continuous) rb->requested = false;
+
+  if(!rb->initialized && !cr_readback_init(ctx)) return false;
+
+  const VkExtent2D extent = ctx->outputs[0].swapchain.dimensions;
+  struct cr_readback_slot_t* slot = NULL;
+  for(uint32_t i = 0; i < CR_READBACK_RING_SIZE; i++) {
+    struct cr_readback_slot_t* candidate = &rb->slots[(rb->next + i) % CR_READBACK_RING_SIZE];
+    if(candidate->state == CR_READBACK_SLOT_FREE) {
+      slot = candidate;
+      rb->next = (rb->next + i + 1) % CR_READBACK_RING_SIZE;
+      break;
+    }
+  }
+  if(!slot || !_slot_fit(ctx, slot, extent)) {
+    rb->n_dropped++;
+    return true;
+  }
+
+  const VkImageSubresourceRange range = {
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .levelCount = 1,
+    .layerCount = 1
+  };
+
+  VkImageMemoryBarrier to_transfer = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    .oldLayout = ctx->outputs[0].swapchain.final_layout,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = range
+  };
+  ctx->vk.CmdPipelineBarrier(
+    cmd,
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0, 0, NULL, 0, NULL, 1, &to_transfer);
+
+  VkBufferImageCopy region = {
+    .bufferOffset = 0,
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .layerCount = 1
+    },
+    .imageExtent = { extent.width, extent.height, 1 }
+  };
+  ctx->vk.CmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buf.handle, 1, &region);
+
+  VkImageMemoryBarrier to_present = to_transfer;
+  to_present.srcAccessMask = 0;
+  to_present.dstAccessMask = 0;
+  to_present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  to_present.newLayout = ctx->outputs[0].swapchain.final_layout;
+
+  VkBufferMemoryBarrier to_host = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = slot->buf.handle,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE
+  };
+  ctx->vk.CmdPipelineBarrier(
+    cmd,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+    0, 0, NULL, 1, &to_host, 1, &to_present);
+
+  slot->state = CR_READBACK_SLOT_PENDING;
+  slot->frame_no = ctx->frameloop.frame_no + 1;
+  slot->frame_idx = frame_idx;
+  slot->width = extent.width;
+  slot->height = extent.height;
+  rb->n_captured++;
+
+  return true;
+}
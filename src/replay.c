@@ -0,0 +1,313 @@
+#include "../include/corender/capture.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/draw.h"
+#include "../include/corender/util.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define _SUBSYS_NAME "REPLAY"
+
+#define _REPLAY_MAX_DRAW_LISTS 64
+
+struct _replay_t {
+  struct cr_context_t ctx;
+  struct cr_draw_list_t lists[_REPLAY_MAX_DRAW_LISTS];
+  bool live[_REPLAY_MAX_DRAW_LISTS];
+
+  double* frame_ms;
+  double* captured_ms;
+  uint32_t n_frames, cap_frames;
+};
+
+static bool _headless_surface_create(VkInstance instance, struct cr_surface_t* o_surf, void* userdata);
+static int  _cmp_double(const void* a, const void* b);
+static void _summarize(const double* ms, uint32_t n, double* o_avg, double* o_p50, double* o_p99);
+static struct cr_draw_list_t* _list(struct _replay_t* rp, uint32_t id);
+static bool _push_frame(struct _replay_t* rp, double ms, double captured_ms);
+static uint32_t _min_payload(uint32_t type);
+static bool _apply(struct _replay_t* rp, const struct cr_capture_record_t* rec, const void* payload);
+
+bool
+_headless_surface_create(VkInstance instance, struct cr_surface_t* o_surf, void* userdata) {
+  (void)instance;
+  const struct cr_capture_init_t* init = userdata;
+  o_surf->surf = VK_NULL_HANDLE;
+  o_surf->width = init->width;
+  o_surf->height = init->height;
+  return true;
+}
+
+int
+_cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+void
+_summarize(const double* ms, uint32_t n, double* o_avg, double* o_p50, double* o_p99) {
+  *o_avg = *o_p50 = *o_p99 = 0.0;
+  if(n == 0) return;
+
+  double* sorted = malloc(n * sizeof *sorted);
+  if(!sorted) return;
+  memcpy(sorted, ms, n * sizeof *sorted);
+  qsort(sorted, n, sizeof *sorted, _cmp_double);
+
+  double sum = 0.0;
+  for(uint32_t i = 0; i < n; i++) sum += sorted[i];
+  *o_avg = sum / n;
+  *o_p50 = sorted[n / 2];
+  *o_p99 = sorted[(uint32_t)((n - 1) * 0.99)];
+  free(sorted);
+}
+
+struct cr_draw_list_t*
+_list(struct _replay_t* rp, uint32_t id) {
+  if(id == 0 || id >= _REPLAY_MAX_DRAW_LISTS || !rp->live[id]) return NULL;
+  return &rp->lists[id];
+}
+
+bool
+_push_frame(struct _replay_t* rp, double ms, double captured_ms) {
+  if(rp->n_frames == rp->cap_frames) {
+    uint32_t cap = rp->cap_frames ? rp->cap_frames * 2 : 1024;
+    double* frame_ms = realloc(rp->frame_ms, cap * sizeof *frame_ms);
+    if(!frame_ms) return false;
+    rp->frame_ms = frame_ms;
+    double* captured = realloc(rp->captured_ms, cap * sizeof *captured);
+    if(!captured) return false;
+    rp->captured_ms = captured;
+    rp->cap_frames = cap;
+  }
+  rp->frame_ms[rp->n_frames] = ms;
+  rp->captured_ms[rp->n_frames] = captured_ms;
+  rp->n_frames++;
+  return true;
+}
+
+uint32_t
+_min_payload(uint32_t type) {
+  switch(type) {
+    case CR_CAPTURE_RECORD_INIT:
+      return sizeof(struct cr_capture_init_t);
+    case CR_CAPTURE_RECORD_FRAME:
+      return sizeof(struct cr_capture_frame_t);
+    case CR_CAPTURE_RECORD_DRAW_LIST_CREATE:
+    case CR_CAPTURE_RECORD_DRAW_LIST_DESTROY:
+      return sizeof(struct cr_capture_draw_list_t);
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_ADD:
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_UPDATE:
+      return sizeof(struct cr_capture_draw_object_t) + sizeof(struct cr_draw_object_t);
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_REMOVE:
+      return sizeof(struct cr_capture_draw_object_t);
+    case CR_CAPTURE_RECORD_READBACK_REQUEST:
+      return sizeof(uint32_t);
+    default:
+      return 0;
+  }
+}
+
+bool
+_apply(struct _replay_t* rp, const struct cr_capture_record_t* rec, const void* payload) {
+  struct cr_context_t* ctx = &rp->ctx;
+
+  switch(rec->type) {
+    case CR_CAPTURE_RECORD_DRAW_LIST_CREATE: {
+      const struct cr_capture_draw_list_t* dl = payload;
+      if(dl->draw_list == 0 || dl->draw_list >= _REPLAY_MAX_DRAW_LISTS) {
+        CR_ERROR(ctx->log, "Capture uses too many draw lists (id: %i)", dl->draw_list);
+        return false;
+      }
+      if(!cr_draw_list_create(ctx, &rp->lists[dl->draw_list], dl->capacity)) return false;
+      rp->live[dl->draw_list] = true;
+      break;
+    }
+    case CR_CAPTURE_RECORD_DRAW_LIST_DESTROY: {
+      const struct cr_capture_draw_list_t* dl = payload;
+      struct cr_draw_list_t* list = _list(rp, dl->draw_list);
+      if(!list) break;
+      if(ctx->outputs[0].draw_list == list) ctx->outputs[0].draw_list = NULL;
+      cr_draw_list_destroy(ctx, list);
+      rp->live[dl->draw_list] = false;
+      break;
+    }
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_ADD:
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_UPDATE:
+    case CR_CAPTURE_RECORD_DRAW_OBJECT_REMOVE: {
+      const struct cr_capture_draw_object_t* obj = payload;
+      struct cr_draw_list_t* list = _list(rp, obj->draw_list);
+      if(!list) break;
+
+      const struct cr_draw_object_t* data = (const struct cr_draw_object_t*)(obj + 1);
+      if(rec->type == CR_CAPTURE_RECORD_DRAW_OBJECT_ADD) {
+        uint32_t id = cr_draw_list_add(list, data);
+        if(id != obj->id) {
+          CR_WARN(ctx->log, "Replay diverged: draw object %i was captured as %i", id, obj->id);
+        }
+      } else if(rec->type == CR_CAPTURE_RECORD_DRAW_OBJECT_UPDATE) {
+        cr_draw_list_update(list, obj->id, data);
+      } else {
+        cr_draw_list_remove(list, obj->id);
+      }
+      break;
+    }
+    case CR_CAPTURE_RECORD_READBACK_REQUEST: {
+      cr_readback_request(ctx, *(const uint32_t*)payload != 0);
+      break;
+    }
+    case CR_CAPTURE_RECORD_UPLOAD: {
+      // Only the CPU copy is replayed; no command reads these bytes.
+      void* dst = cr_frame_upload_alloc(ctx, rec->size, 1, NULL, NULL);
+      if(dst) memcpy(dst, payload, rec->size);
+      break;
+    }
+    default:
+      CR_WARN(ctx->log, "Skipping unknown capture record (type: %i, size: %i)", rec->type, rec->size);
+      break;
+  }
+  return true;
+}
+
+bool
+cr_replay_run(const char* path, const struct cr_replay_options_t* opts, struct cr_replay_stats_t* o_stats) {
+  struct cr_log_state_t log = { .stream = stdout, .verbose = opts->log_verbose };
+  memset(o_stats, 0, sizeof *o_stats);
+
+  if(opts->o_frame_ms && opts->max_frames == 0) {
+    CR_ERROR(log, "opts->o_frame_ms requires opts->max_frames to bound its size.");
+    return false;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    CR_ERROR(log, "Failed to open capture '%s'.", path);
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct cr_capture_header_t)) {
+    CR_ERROR(log, "Capture '%s' is truncated.", path);
+    close(fd);
+    return false;
+  }
+  const size_t size = (size_t)st.st_size;
+  const uint8_t* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    CR_ERROR(log, "Failed to map capture '%s'.", path);
+    return false;
+  }
+  madvise((void*)data, size, MADV_SEQUENTIAL);
+
+  bool ok = false;
+  struct _replay_t* rp = calloc(1, sizeof *rp);
+  const struct cr_capture_header_t* header = (const struct cr_capture_header_t*)data;
+  size_t offset = sizeof *header;
+  const struct cr_capture_record_t* rec = (const struct cr_capture_record_t*)(data + offset);
+
+  if(!rp) goto out;
+  if(memcmp(header->magic, CR_CAPTURE_MAGIC, sizeof header->magic) != 0) {
+    CR_ERROR(log, "'%s' is not a corender capture.", path);
+    goto out;
+  }
+  if(header->version != CR_CAPTURE_VERSION) {
+    CR_ERROR(log, "'%s' is a version %i capture, expected version %i.", path, header->version, CR_CAPTURE_VERSION);
+    goto out;
+  }
+  if(offset + sizeof *rec > size || rec->type != CR_CAPTURE_RECORD_INIT ||
+     rec->size < sizeof(struct cr_capture_init_t) || offset + sizeof *rec + rec->size > size) {
+    CR_ERROR(log, "Capture '%s' does not start with an init record.", path);
+    goto out;
+  }
+
+  struct cr_capture_init_t init = *(const struct cr_capture_init_t*)(rec + 1);
+  struct cr_context_init_info_t info = {
+    .enable_validation = opts->enable_validation,
+    .log_verbose = opts->log_verbose,
+    .surface_create = _headless_surface_create,
+    .surface_userdata = &init
+  };
+  if(!cr_context_create(&rp->ctx, &info)) {
+    CR_ERROR(log, "Failed to create headless replay context.");
+    goto out;
+  }
+
+  uint64_t start = cr_util_time_ns(), last = start;
+  while(offset + sizeof *rec <= size) {
+    rec = (const struct cr_capture_record_t*)(data + offset);
+    const void* payload = rec + 1;
+    offset += sizeof *rec + (((size_t)rec->size + 7) & ~(size_t)7);
+    if(offset > size) {
+      CR_WARN(log, "Capture '%s' ends with a truncated record.", path);
+      break;
+    }
+    if(rec->size < _min_payload(rec->type)) {
+      CR_ERROR(log, "Capture record %i is too small (size: %i, expected at least: %i)",
+               rec->type, rec->size, _min_payload(rec->type));
+      goto out;
+    }
+
+    if(rec->type == CR_CAPTURE_RECORD_INIT) continue;
+    if(rec->type != CR_CAPTURE_RECORD_FRAME) {
+      if(!_apply(rp, rec, payload)) goto out;
+      continue;
+    }
+
+    const struct cr_capture_frame_t* frame = payload;
+    rp->ctx.outputs[0].draw_list = _list(rp, frame->draw_list);
+    if(!cr_draw_frame(&rp->ctx)) {
+      CR_ERROR(log, "Replay of frame %i failed.", rp->n_frames);
+      goto out;
+    }
+
+    struct cr_readback_image_t img;
+    while(cr_readback_acquire(&rp->ctx, &img)) {
+      cr_readback_release(&rp->ctx, &img);
+    }
+
+    uint64_t now = cr_util_time_ns();
+    if(!_push_frame(rp, (now - last) / 1e6, frame->frame_ns / 1e6)) goto out;
+    last = now;
+
+    if(opts->max_frames && rp->n_frames >= opts->max_frames) break;
+  }
+  rp->ctx.vk.DeviceWaitIdle(rp->ctx.logical_dev);
+
+  o_stats->n_frames = rp->n_frames;
+  o_stats->total_ms = (cr_util_time_ns() - start) / 1e6;
+  o_stats->min_ms = rp->n_frames ? rp->frame_ms[0] : 0.0;
+  o_stats->max_ms = o_stats->min_ms;
+  for(uint32_t i = 0; i < rp->n_frames; i++) {
+    if(rp->frame_ms[i] < o_stats->min_ms) o_stats->min_ms = rp->frame_ms[i];
+    if(rp->frame_ms[i] > o_stats->max_ms) o_stats->max_ms = rp->frame_ms[i];
+  }
+  _summarize(rp->frame_ms, rp->n_frames, &o_stats->avg_ms, &o_stats->p50_ms, &o_stats->p99_ms);
+
+  double captured_p50;
+  _summarize(rp->captured_ms, rp->n_frames, &o_stats->captured_avg_ms, &captured_p50, &o_stats->captured_p99_ms);
+
+  if(opts->o_frame_ms) {
+    const uint32_t n = rp->n_frames < opts->max_frames ? rp->n_frames : opts->max_frames;
+    memcpy(opts->o_frame_ms, rp->frame_ms, n * sizeof(double));
+  }
+  ok = true;
+
+out:
+  if(rp) {
+    if(rp->ctx.logical_dev) {
+      rp->ctx.vk.DeviceWaitIdle(rp->ctx.logical_dev);
+      for(uint32_t i = 0; i < _REPLAY_MAX_DRAW_LISTS; i++) {
+        if(rp->live[i]) cr_draw_list_destroy(&rp->ctx, &rp->lists[i]);
+      }
+      cr_context_destroy(&rp->ctx);
+    }
+    free(rp->frame_ms);
+    free(rp->captured_ms);
+    free(rp);
+  }
+  munmap((void*)data, size);
+  return ok;
+}
@@ -0,0 +1,253 @@
+#include "../include/corender/shm.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <unistd.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "SHM"
+
+#define _BYTES_PER_PIXEL 4
+
+static bool _format_supported(VkFormat fmt);
+static bool _importable(struct cr_context_t* ctx, const struct cr_shm_buffer_t* shm, uintptr_t* o_base, size_t* o_size);
+static bool _import(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm, uintptr_t base, size_t size);
+static void _create_texel_view(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm);
+
+bool
+_format_supported(VkFormat fmt) {
+  switch(fmt) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+_importable(struct cr_context_t* ctx, const struct cr_shm_buffer_t* shm, uintptr_t* o_base, size_t* o_size) {
+  if(!ctx->features.external_memory_host || ctx->features.host_pointer_alignment == 0) return false;
+
+  // Copy offsets into the buffer must stay texel aligned.
+  const uintptr_t addr = (uintptr_t)shm->ptr;
+  if(addr % _BYTES_PER_PIXEL != 0 || shm->stride % _BYTES_PER_PIXEL != 0) return false;
+
+  // The import may be widened to the device's alignment only while it
+  // stays within the pages the client mapping covers anyway; beyond page
+  // size the region itself has to be aligned.
+  const uintptr_t align = (uintptr_t)ctx->features.host_pointer_alignment;
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  if(align > page && (addr % align != 0 || shm->size % align != 0)) return false;
+
+  const uintptr_t base = addr & ~(align - 1);
+  const uintptr_t end = (addr + shm->size + align - 1) & ~(align - 1);
+  *o_base = base;
+  *o_size = end - base;
+  return true;
+}
+
+bool
+_import(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm, uintptr_t base, size_t size) {
+  VkMemoryHostPointerPropertiesEXT host_props = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT
+  };
+  if(ctx->vk.GetMemoryHostPointerPropertiesEXT(ctx->logical_dev, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                                               (const void*)base, &host_props) != VK_SUCCESS || !host_props.memoryTypeBits) {
+    CR_TRACE(ctx->log, "Host pointer %p cannot be imported, falling back to copies.", (const void*)base);
+    return false;
+  }
+
+  VkExternalMemoryBufferCreateInfo external_info = {
+    .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+  };
+  VkBufferCreateInfo buf_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = &external_info,
+    .size = size,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+  };
+  struct cr_buffer_t* buf = &shm->buf;
+  _VK_CHECK(ctx, ctx->vk.CreateBuffer(ctx->logical_dev, &buf_info, ctx->host.vk_alloc, &buf->handle));
+
+  VkMemoryRequirements reqs;
+  ctx->vk.GetBufferMemoryRequirements(ctx->logical_dev, buf->handle, &reqs);
+  reqs.memoryTypeBits &= host_props.memoryTypeBits;
+  reqs.size = size;
+
+  VkImportMemoryHostPointerInfoEXT import_info = {
+    .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+    .pHostPointer = (void*)base
+  };
+  uint32_t type;
+  if(!reqs.memoryTypeBits || !cr_memory_alloc_chained(ctx, &reqs, 0, &import_info, &buf->mem, &type)) {
+    ctx->vk.DestroyBuffer(ctx->logical_dev, buf->handle, ctx->host.vk_alloc);
+    memset(buf, 0, sizeof *buf);
+    return false;
+  }
+  buf->size = size;
+  buf->mem_size = size;
+  buf->mem_type = type;
+  _VK_CHECK(ctx, ctx->vk.BindBufferMemory(ctx->logical_dev, buf->handle, buf->mem, 0));
+
+  shm->offset = (uintptr_t)shm->ptr - base;
+  shm->imported = true;
+  return true;
+}
+
+void
+_create_texel_view(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm) {
+  VkFormatProperties fmt_props;
+  ctx->vk.GetPhysicalDeviceFormatProperties(ctx->phys_dev, shm->fmt, &fmt_props);
+  if(!(fmt_props.bufferFeatures & VK_FORMAT_FEATURE_UNIFORM_TEXEL_BUFFER_BIT)) return;
+
+  VkPhysicalDeviceProperties props;
+  ctx->vk.GetPhysicalDeviceProperties(ctx->phys_dev, &props);
+  const VkDeviceSize range = (VkDeviceSize)shm->stride * shm->extent.height;
+  if(shm->offset % props.limits.minTexelBufferOffsetAlignment != 0 ||
+     range / _BYTES_PER_PIXEL > props.limits.maxTexelBufferElements) return;
+
+  VkBufferViewCreateInfo view_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO,
+    .buffer = shm->buf.handle,
+    .format = shm->fmt,
+    .offset = shm->offset,
+    .range = range
+  };
+  if(ctx->vk.CreateBufferView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &shm->texel_view) != VK_SUCCESS) {
+    shm->texel_view = VK_NULL_HANDLE;
+  }
+}
+
+bool
+cr_shm_import(
+  struct cr_context_t* ctx,
+  struct cr_shm_buffer_t* o_shm,
+  const void* ptr,
+  size_t size,
+  VkExtent2D extent,
+  uint32_t stride,
+  VkFormat fmt) {
+  memset(o_shm, 0, sizeof *o_shm);
+  if(!ptr || !_format_supported(fmt) || stride < extent.width * _BYTES_PER_PIXEL ||
+     (size_t)stride * extent.height > size) {
+    CR_ERROR(ctx->log, "Invalid shared memory region (size: %lu, width: %i, height: %i, stride: %i, format: %i)",
+             (unsigned long)size, extent.width, extent.height, stride, fmt);
+    return false;
+  }
+
+  o_shm->ptr = ptr;
+  o_shm->size = size;
+  o_shm->extent = extent;
+  o_shm->stride = stride;
+  o_shm->fmt = fmt;
+
+  uintptr_t base;
+  size_t import_size;
+  if(_importable(ctx, o_shm, &base, &import_size) && _import(ctx, o_shm, base, import_size)) {
+    _create_texel_view(ctx, o_shm);
+  }
+
+  CR_TRACE(ctx->log, "Registered shared memory region (size: %lu, width: %i, height: %i, imported: %s, texel view: %s)",
+           (unsigned long)size, extent.width, extent.height,
+           o_shm->imported ? "true" : "false", o_shm->texel_view ? "true" : "false");
+
+  return true;
+}
+
+bool
+cr_shm_record_copy(
+  struct cr_context_t* ctx,
+  VkCommandBuffer cmd,
+  struct cr_shm_buffer_t* shm,
+  VkImage dst,
+  VkRect2D damage) {
+  // Clip the damage to the client buffer.
+  uint32_t x = (uint32_t)(damage.offset.x > 0 ? damage.offset.x : 0);
+  uint32_t y = (uint32_t)(damage.offset.y > 0 ? damage.offset.y : 0);
+  if(x >= shm->extent.width || y >= shm->extent.height) return true;
+  uint32_t w = CR_MIN(damage.extent.width, shm->extent.width - x);
+  uint32_t h = CR_MIN(damage.extent.height, shm->extent.height - y);
+  if(w == 0 || h == 0) return true;
+
+  VkBufferImageCopy region = {
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .layerCount = 1
+    },
+    .imageOffset = { (int32_t)x, (int32_t)y, 0 },
+    .imageExtent = { w, h, 1 }
+  };
+  VkBuffer src;
+
+  if(shm->imported) {
+    src = shm->buf.handle;
+    region.bufferOffset = shm->offset + (VkDeviceSize)y * shm->stride + (VkDeviceSize)x * _BYTES_PER_PIXEL;
+    region.bufferRowLength = shm->stride / _BYTES_PER_PIXEL;
+    region.bufferImageHeight = h;
+  } else {
+    // Only the damaged rows are copied, tightly packed.
+    const size_t row_size = (size_t)w * _BYTES_PER_PIXEL;
+    const VkDeviceSize size = (VkDeviceSize)row_size * h;
+
+    VkDeviceSize offset = 0;
+    uint8_t* staging = cr_frame_upload_alloc(ctx, size, _BYTES_PER_PIXEL, &src, &offset);
+    if(!staging) {
+      // Larger than the frame's upload memory: a one-off staging buffer,
+      // retired once the frame completes.
+      struct cr_buffer_t tmp;
+      if(!cr_buffer_create_staging(ctx, &tmp, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT)) {
+        CR_ERROR(ctx->log, "Failed to create staging buffer for shared memory update (size: %lu)",
+                 (unsigned long)size);
+        return false;
+      }
+      staging = tmp.mapped;
+      src = tmp.handle;
+      offset = 0;
+      // The copy below happens before the retire point is reached.
+      cr_deletion_push_buffer(ctx, &tmp);
+    }
+
+    const uint8_t* row = shm->ptr + (size_t)y * shm->stride + (size_t)x * _BYTES_PER_PIXEL;
+    for(uint32_t i = 0; i < h; i++) {
+      memcpy(staging + i * row_size, row, row_size);
+      row += shm->stride;
+    }
+    region.bufferOffset = offset;
+  }
+
+  ctx->vk.CmdCopyBufferToImage(cmd, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  cr_shm_mark_used(ctx, shm);
+  return true;
+}
+
+void
+cr_shm_mark_used(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm) {
+  // Copies from upload memory finish reading the client memory on the CPU,
+  // but the submission still gates when the client may write again.
+  shm->last_use_no = ctx->frameloop.frame_no + 1;
+}
+
+bool
+cr_shm_busy(struct cr_context_t* ctx, const struct cr_shm_buffer_t* shm) {
+  return shm->last_use_no > ctx->frameloop.completed_no;
+}
+
+void
+cr_shm_release(struct cr_context_t* ctx, struct cr_shm_buffer_t* shm) {
+  if(shm->texel_view) {
+    cr_deletion_push(ctx, CR_DELETION_BUFFER_VIEW, (union cr_deletion_handle_t){ .buffer_view = shm->texel_view });
+  }
+  cr_deletion_push_buffer(ctx, &shm->buf);
+
+  // The mapping must outlive the imported memory, which the deletion queue
+  // frees with the frame being built; cr_shm_busy keeps reporting that.
+  const uint64_t retire_no = shm->imported ? ctx->frameloop.frame_no + 1 : shm->last_use_no;
+  memset(shm, 0, sizeof *shm);
+  shm->last_use_no = retire_no;
+}
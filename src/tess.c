@@ -0,0 +1,378 @@
+#include "../include/corender/tess.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define _TESS_X86 1
+#include <immintrin.h>
+#endif
+
+#define _SUBSYS_NAME "TESS"
+
+#define _TESS_MAX_POINTS (4 * (CR_TESS_MAX_SEGMENTS + 1))
+
+// Unit contour of a rounded rect with `segs` segments per corner, walked
+// clockwise (in y-down screen space) from the left edge of the top-left
+// corner. A point is center(sx, sy) + radius * (cos, sin), where the corner
+// selectors sx/sy pick the left/right and top/bottom corner centers.
+struct _tess_table_t {
+  uint32_t n;
+  _Alignas(32) float cos[_TESS_MAX_POINTS];
+  _Alignas(32) float sin[_TESS_MAX_POINTS];
+  _Alignas(32) float sx[_TESS_MAX_POINTS];
+  _Alignas(32) float sy[_TESS_MAX_POINTS];
+};
+
+// x[i] = cx + sx[i] * dx + r * cos[i], same for y.
+typedef void (*_tess_contour_func_t)(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y);
+
+static void _contour_scalar(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y);
+#ifdef _TESS_X86
+static void _contour_sse2(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y);
+static void _contour_avx2(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y);
+#endif
+
+static void     _init_tables(void);
+static bool     _backend_supported(enum cr_tess_backend_t backend);
+static uint32_t _segments_for_radius(float r);
+static bool     _reserve(struct cr_tess_batch_t* batch, uint32_t n_verts, uint32_t n_indices);
+static uint32_t _emit_contour(
+  struct cr_tess_batch_t* batch, const struct _tess_table_t* tbl,
+  struct cr_tess_rect_t rect, float radius, float expand, float alpha, uint32_t color);
+static void     _emit_fan(struct cr_tess_batch_t* batch, uint32_t base, uint32_t n);
+static void     _emit_strip(struct cr_tess_batch_t* batch, uint32_t a, uint32_t b, uint32_t n);
+static void     _emit_filled(
+  struct cr_tess_batch_t* batch, struct cr_tess_rect_t rect, float radius,
+  float inner, float outer, uint32_t color);
+
+static struct _tess_table_t   _tables[CR_TESS_MAX_SEGMENTS + 1];
+static bool                   _tables_ready = false;
+static enum cr_tess_backend_t _backend = CR_TESS_BACKEND_AUTO;
+static _tess_contour_func_t   _contour = NULL;
+
+void
+_contour_scalar(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y) {
+  for(uint32_t i = 0; i < tbl->n; i++) {
+    o_x[i] = cx + tbl->sx[i] * dx + r * tbl->cos[i];
+    o_y[i] = cy + tbl->sy[i] * dy + r * tbl->sin[i];
+  }
+}
+
+#ifdef _TESS_X86
+__attribute__((target("sse2"))) void
+_contour_sse2(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y) {
+  const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy);
+  const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+  const __m128 vr  = _mm_set1_ps(r);
+
+  uint32_t i = 0;
+  for(; i + 4 <= tbl->n; i += 4) {
+    __m128 x = _mm_add_ps(vcx, _mm_mul_ps(_mm_load_ps(&tbl->sx[i]), vdx));
+    __m128 y = _mm_add_ps(vcy, _mm_mul_ps(_mm_load_ps(&tbl->sy[i]), vdy));
+    x = _mm_add_ps(x, _mm_mul_ps(_mm_load_ps(&tbl->cos[i]), vr));
+    y = _mm_add_ps(y, _mm_mul_ps(_mm_load_ps(&tbl->sin[i]), vr));
+    _mm_storeu_ps(&o_x[i], x);
+    _mm_storeu_ps(&o_y[i], y);
+  }
+  for(; i < tbl->n; i++) {
+    o_x[i] = cx + tbl->sx[i] * dx + r * tbl->cos[i];
+    o_y[i] = cy + tbl->sy[i] * dy + r * tbl->sin[i];
+  }
+}
+
+__attribute__((target("avx2,fma"))) void
+_contour_avx2(
+  const struct _tess_table_t* tbl,
+  float cx, float cy, float dx, float dy, float r,
+  float* o_x, float* o_y) {
+  const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy);
+  const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+  const __m256 vr  = _mm256_set1_ps(r);
+
+  uint32_t i = 0;
+  for(; i + 8 <= tbl->n; i += 8) {
+    __m256 x = _mm256_fmadd_ps(_mm256_load_ps(&tbl->sx[i]), vdx, vcx);
+    __m256 y = _mm256_fmadd_ps(_mm256_load_ps(&tbl->sy[i]), vdy, vcy);
+    x = _mm256_fmadd_ps(_mm256_load_ps(&tbl->cos[i]), vr, x);
+    y = _mm256_fmadd_ps(_mm256_load_ps(&tbl->sin[i]), vr, y);
+    _mm256_storeu_ps(&o_x[i], x);
+    _mm256_storeu_ps(&o_y[i], y);
+  }
+  for(; i < tbl->n; i++) {
+    o_x[i] = cx + tbl->sx[i] * dx + r * tbl->cos[i];
+    o_y[i] = cy + tbl->sy[i] * dy + r * tbl->sin[i];
+  }
+}
+#endif
+
+void
+_init_tables(void) {
+  const float pi = 3.14159265358979f;
+  for(uint32_t segs = 1; segs <= CR_TESS_MAX_SEGMENTS; segs++) {
+    struct _tess_table_t* tbl = &_tables[segs];
+    tbl->n = 0;
+    for(uint32_t corner = 0; corner < 4; corner++) {
+      for(uint32_t i = 0; i <= segs; i++) {
+        float angle = pi + corner * (pi * 0.5f) + i * (pi * 0.5f) / segs;
+        tbl->cos[tbl->n] = cosf(angle);
+        tbl->sin[tbl->n] = sinf(angle);
+        tbl->sx[tbl->n] = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+        tbl->sy[tbl->n] = (corner == 2 || corner == 3) ? 1.0f : 0.0f;
+        tbl->n++;
+      }
+    }
+  }
+  _tables_ready = true;
+}
+
+bool
+_backend_supported(enum cr_tess_backend_t backend) {
+  switch(backend) {
+    case CR_TESS_BACKEND_SCALAR: return true;
+#ifdef _TESS_X86
+    case CR_TESS_BACKEND_SSE2: return __builtin_cpu_supports("sse2");
+    case CR_TESS_BACKEND_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    default: return false;
+  }
+}
+
+bool
+cr_tess_set_backend(enum cr_tess_backend_t backend) {
+  if(backend == CR_TESS_BACKEND_AUTO) {
+    if(_backend_supported(CR_TESS_BACKEND_AVX2))      backend = CR_TESS_BACKEND_AVX2;
+    else if(_backend_supported(CR_TESS_BACKEND_SSE2)) backend = CR_TESS_BACKEND_SSE2;
+    else                                              backend = CR_TESS_BACKEND_SCALAR;
+  }
+  if(!_backend_supported(backend)) return false;
+
+  switch(backend) {
+#ifdef _TESS_X86
+    case CR_TESS_BACKEND_SSE2: _contour = _contour_sse2; break;
+    case CR_TESS_BACKEND_AVX2: _contour = _contour_avx2; break;
+#endif
+    default: _contour = _contour_scalar; break;
+  }
+  _backend = backend;
+  return true;
+}
+
+enum cr_tess_backend_t
+cr_tess_get_backend(void) {
+  if(!_contour) cr_tess_set_backend(CR_TESS_BACKEND_AUTO);
+  return _backend;
+}
+
+const char*
+cr_tess_backend_name(enum cr_tess_backend_t backend) {
+  static const char* names[CR_TESS_BACKEND_COUNT] = { "auto", "scalar", "sse2", "avx2" };
+  return backend < CR_TESS_BACKEND_COUNT ? names[backend] : "unknown";
+}
+
+uint32_t
+_segments_for_radius(float r) {
+  uint32_t segs = (uint32_t)ceilf(r * 0.5f);
+  if(segs < 1) segs = 1;
+  if(segs > CR_TESS_MAX_SEGMENTS) segs = CR_TESS_MAX_SEGMENTS;
+  return segs;
+}
+
+bool
+_reserve(struct cr_tess_batch_t* batch, uint32_t n_verts, uint32_t n_indices) {
+  if(batch->n_verts + n_verts > batch->cap_verts ||
+     batch->n_indices + n_indices > batch->cap_indices) {
+    batch->overflow = true;
+    return false;
+  }
+  return true;
+}
+
+uint32_t
+_emit_contour(
+  struct cr_tess_batch_t* batch, const struct _tess_table_t* tbl,
+  struct cr_tess_rect_t rect, float radius, float expand, float alpha, uint32_t color) {
+  float w = rect.w + 2.0f * expand;
+  float h = rect.h + 2.0f * expand;
+  if(w < 0.0f) w = 0.0f;
+  if(h < 0.0f) h = 0.0f;
+
+  float r = radius + expand;
+  if(r < 0.0f) r = 0.0f;
+  if(r > w * 0.5f) r = w * 0.5f;
+  if(r > h * 0.5f) r = h * 0.5f;
+
+  const float cx = rect.x + rect.w * 0.5f - w * 0.5f + r;
+  const float cy = rect.y + rect.h * 0.5f - h * 0.5f + r;
+
+  uint32_t base = batch->n_verts;
+  _contour(tbl, cx, cy, w - 2.0f * r, h - 2.0f * r, r, &batch->x[base], &batch->y[base]);
+  for(uint32_t i = 0; i < tbl->n; i++) {
+    batch->alpha[base + i] = alpha;
+    batch->color[base + i] = color;
+  }
+  batch->n_verts += tbl->n;
+  return base;
+}
+
+void
+_emit_fan(struct cr_tess_batch_t* batch, uint32_t base, uint32_t n) {
+  uint32_t* idx = &batch->indices[batch->n_indices];
+  for(uint32_t i = 1; i + 1 < n; i++) {
+    *idx++ = base;
+    *idx++ = base + i;
+    *idx++ = base + i + 1;
+  }
+  batch->n_indices += 3 * (n - 2);
+}
+
+void
+_emit_strip(struct cr_tess_batch_t* batch, uint32_t a, uint32_t b, uint32_t n) {
+  uint32_t* idx = &batch->indices[batch->n_indices];
+  for(uint32_t i = 0; i < n; i++) {
+    uint32_t j = (i + 1 == n) ? 0 : i + 1;
+    *idx++ = a + i; *idx++ = b + i; *idx++ = b + j;
+    *idx++ = a + i; *idx++ = b + j; *idx++ = a + j;
+  }
+  batch->n_indices += 6 * n;
+}
+
+void
+_emit_filled(
+  struct cr_tess_batch_t* batch, struct cr_tess_rect_t rect, float radius,
+  float inner, float outer, uint32_t color) {
+  if(!_contour) cr_tess_set_backend(CR_TESS_BACKEND_AUTO);
+  if(!_tables_ready) _init_tables();
+
+  const struct _tess_table_t* tbl = &_tables[_segments_for_radius(radius + outer)];
+  if(!_reserve(batch, 2 * tbl->n, 3 * (tbl->n - 2) + 6 * tbl->n)) return;
+
+  uint32_t in  = _emit_contour(batch, tbl, rect, radius, inner, 1.0f, color);
+  uint32_t out = _emit_contour(batch, tbl, rect, radius, outer, 0.0f, color);
+  _emit_fan(batch, in, tbl->n);
+  _emit_strip(batch, in, out, tbl->n);
+}
+
+size_t
+cr_tess_batch_mem_size(uint32_t max_verts, uint32_t max_indices) {
+  size_t cap_verts = (max_verts + 7u) & ~7u;
+  return cap_verts * (2 * sizeof(float) + sizeof(float) + sizeof(uint32_t)) +
+    (size_t)max_indices * sizeof(uint32_t);
+}
+
+void
+cr_tess_batch_init(
+  struct cr_tess_batch_t* o_batch,
+  void* mem,
+  uint32_t max_verts,
+  uint32_t max_indices) {
+  memset(o_batch, 0, sizeof *o_batch);
+  uint32_t cap_verts = (max_verts + 7u) & ~7u;
+
+  o_batch->offsets[CR_TESS_STREAM_X]     = 0;
+  o_batch->offsets[CR_TESS_STREAM_Y]     = (VkDeviceSize)cap_verts * sizeof(float);
+  o_batch->offsets[CR_TESS_STREAM_ALPHA] = (VkDeviceSize)cap_verts * sizeof(float) * 2;
+  o_batch->offsets[CR_TESS_STREAM_COLOR] = (VkDeviceSize)cap_verts * sizeof(float) * 3;
+  o_batch->offsets[CR_TESS_STREAM_INDEX] = (VkDeviceSize)cap_verts * sizeof(float) * 4;
+
+  uint8_t* base = mem;
+  o_batch->x       = (float*)(base + o_batch->offsets[CR_TESS_STREAM_X]);
+  o_batch->y       = (float*)(base + o_batch->offsets[CR_TESS_STREAM_Y]);
+  o_batch->alpha   = (float*)(base + o_batch->offsets[CR_TESS_STREAM_ALPHA]);
+  o_batch->color   = (uint32_t*)(base + o_batch->offsets[CR_TESS_STREAM_COLOR]);
+  o_batch->indices = (uint32_t*)(base + o_batch->offsets[CR_TESS_STREAM_INDEX]);
+
+  o_batch->cap_verts = cap_verts;
+  o_batch->cap_indices = max_indices;
+}
+
+bool
+cr_tess_batch_begin(
+  struct cr_context_t* ctx,
+  struct cr_tess_batch_t* o_batch,
+  uint32_t max_verts,
+  uint32_t max_indices) {
+  VkBuffer buf;
+  VkDeviceSize offset;
+  void* mem = cr_frame_upload_alloc(
+    ctx, cr_tess_batch_mem_size(max_verts, max_indices), 32, &buf, &offset);
+  if(!mem) {
+    CR_ERROR(ctx->log, "Failed to allocate tessellation batch (vertices: %i, indices: %i)",
+             max_verts, max_indices);
+    return false;
+  }
+
+  cr_tess_batch_init(o_batch, mem, max_verts, max_indices);
+  o_batch->buf = buf;
+  for(uint32_t i = 0; i < CR_TESS_STREAM_COUNT; i++) {
+    o_batch->offsets[i] += offset;
+  }
+  return true;
+}
+
+void
+cr_tess_rounded_rect(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  uint32_t color) {
+  _emit_filled(batch, rect, radius, -0.5f, 0.5f, color);
+}
+
+void
+cr_tess_shadow(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  float blur,
+  uint32_t color) {
+  if(blur < 1.0f) blur = 1.0f;
+  _emit_filled(batch, rect, radius, -blur * 0.5f, blur * 0.5f, color);
+}
+
+void
+cr_tess_border(
+  struct cr_tess_batch_t* batch,
+  struct cr_tess_rect_t rect,
+  float radius,
+  float width,
+  uint32_t color) {
+  if(!_contour) cr_tess_set_backend(CR_TESS_BACKEND_AUTO);
+  if(!_tables_ready) _init_tables();
+
+  const struct _tess_table_t* tbl = &_tables[_segments_for_radius(radius + 0.5f)];
+  if(!_reserve(batch, 4 * tbl->n, 18 * tbl->n)) return;
+
+  // Hairlines thinner than a pixel collapse the solid band and fade out
+  // instead of aliasing.
+  const float coverage = width < 1.0f ? width : 1.0f;
+  const float band_out = width < 1.0f ? -width * 0.5f : -0.5f;
+  const float band_in  = width < 1.0f ? -width * 0.5f : -width + 0.5f;
+
+  uint32_t c0 = _emit_contour(batch, tbl, rect, radius, 0.5f, 0.0f, color);
+  uint32_t c1 = _emit_contour(batch, tbl, rect, radius, band_out, coverage, color);
+  uint32_t c2 = _emit_contour(batch, tbl, rect, radius, band_in, coverage, color);
+  uint32_t c3 = _emit_contour(batch, tbl, rect, radius, -width - 0.5f, 0.0f, color);
+  _emit_strip(batch, c0, c1, tbl->n);
+  _emit_strip(batch, c1, c2, tbl->n);
+  _emit_strip(batch, c2, c3, tbl->n);
+}
@@ -0,0 +1,478 @@
+#include "../include/corender/text.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "TEXT"
+
+#define _SHAPE_TABLE_SIZE (CR_TEXT_SHAPE_CACHE_SIZE * 2)
+#define _REPLACEMENT_CHAR 0xfffd
+
+struct cr_text_glyph_t {
+  // 0 marks an empty table slot.
+  uint64_t key;
+  uint32_t width, height;
+  int32_t bearing_x, bearing_y;
+  float advance;
+};
+
+struct _shaped_glyph_t {
+  uint32_t codepoint;
+  float x;
+};
+
+struct cr_text_shape_t {
+  uint64_t hash;
+  uint32_t font;
+  float size;
+  // Owns `str` and `glyphs` in one allocation; NULL marks an empty slot.
+  char* str;
+  struct _shaped_glyph_t* glyphs;
+  uint32_t n_glyphs;
+  uint64_t last_use_no;
+};
+
+static uint64_t _glyph_key(uint32_t font, float size, uint32_t codepoint);
+static uint64_t _hash_string(uint32_t font, float size, const char* str, size_t len);
+static uint32_t _utf8_decode(const char** str);
+static struct cr_text_glyph_t* _glyph_find(struct cr_text_t* text, uint64_t key);
+static bool     _glyph_grow(struct cr_context_t* ctx, struct cr_text_t* text);
+static bool     _rasterize(struct cr_context_t* ctx, struct cr_text_t* text, uint32_t font, float size, uint32_t codepoint,
+                           struct cr_text_glyph_t** o_glyph);
+static struct cr_text_shape_t* _shape_find(struct cr_text_t* text, uint32_t font, float size, const char* str, uint64_t hash);
+static void     _shape_evict(struct cr_context_t* ctx, struct cr_text_t* text);
+static struct cr_text_shape_t* _shape(struct cr_context_t* ctx, struct cr_text_t* text, uint32_t font, float size, const char* str);
+static bool     _push_instance(struct cr_context_t* ctx, struct cr_text_t* text, const struct cr_text_instance_t* inst);
+
+uint64_t
+_glyph_key(uint32_t font, float size, uint32_t codepoint) {
+  // Sizes are told apart in quarter pixels; the top bit keeps keys non-zero.
+  const uint64_t size_q = (uint64_t)(size * 4.0f + 0.5f);
+  return 1ull << 63 | (uint64_t)(font & 0x7fff) << 48 | (size_q & 0xffff) << 32 | codepoint;
+}
+
+uint64_t
+_hash_string(uint32_t font, float size, const char* str, size_t len) {
+  // FNV-1a over the string, seeded with the font and size.
+  uint64_t hash = 0xcbf29ce484222325ull ^ _glyph_key(font, size, 0);
+  for(size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint32_t
+_utf8_decode(const char** str) {
+  const uint8_t* s = (const uint8_t*)*str;
+  uint32_t cp, n;
+  if(s[0] < 0x80) {
+    cp = s[0];
+    n = 0;
+  } else if((s[0] & 0xe0) == 0xc0) {
+    cp = s[0] & 0x1f;
+    n = 1;
+  } else if((s[0] & 0xf0) == 0xe0) {
+    cp = s[0] & 0x0f;
+    n = 2;
+  } else if((s[0] & 0xf8) == 0xf0) {
+    cp = s[0] & 0x07;
+    n = 3;
+  } else {
+    *str += 1;
+    return _REPLACEMENT_CHAR;
+  }
+
+  for(uint32_t i = 1; i <= n; i++) {
+    if((s[i] & 0xc0) != 0x80) {
+      *str += i;
+      return _REPLACEMENT_CHAR;
+    }
+    cp = cp << 6 | (s[i] & 0x3f);
+  }
+  *str += n + 1;
+  return cp;
+}
+
+struct cr_text_glyph_t*
+_glyph_find(struct cr_text_t* text, uint64_t key) {
+  if(!text->glyph_cap) return NULL;
+  const uint32_t mask = text->glyph_cap - 1;
+  for(uint32_t i = (uint32_t)(key ^ key >> 32) & mask; text->glyphs[i].key; i = (i + 1) & mask) {
+    if(text->glyphs[i].key == key) return &text->glyphs[i];
+  }
+  return NULL;
+}
+
+bool
+_glyph_grow(struct cr_context_t* ctx, struct cr_text_t* text) {
+  const uint32_t cap = text->glyph_cap ? text->glyph_cap * 2 : 256;
+  struct cr_text_glyph_t* glyphs = cr_host_calloc(ctx, cap, sizeof *glyphs);
+  if(!glyphs) return false;
+
+  for(uint32_t i = 0; i < text->glyph_cap; i++) {
+    const struct cr_text_glyph_t* glyph = &text->glyphs[i];
+    if(!glyph->key) continue;
+    uint32_t j = (uint32_t)(glyph->key ^ glyph->key >> 32) & (cap - 1);
+    while(glyphs[j].key) j = (j + 1) & (cap - 1);
+    glyphs[j] = *glyph;
+  }
+  cr_host_free(ctx, text->glyphs);
+  text->glyphs = glyphs;
+  text->glyph_cap = cap;
+  return true;
+}
+
+bool
+_rasterize(struct cr_context_t* ctx, struct cr_text_t* text, uint32_t font, float size, uint32_t codepoint,
+           struct cr_text_glyph_t** o_glyph) {
+  // Codepoints the font lacks are cached as the replacement character.
+  struct cr_glyph_bitmap_t bitmap = {0};
+  if(!text->rasterize(font, size, codepoint, &bitmap, text->userdata) &&
+     (codepoint == _REPLACEMENT_CHAR || !text->rasterize(font, size, _REPLACEMENT_CHAR, &bitmap, text->userdata))) {
+    return false;
+  }
+  text->n_rasterized++;
+
+  const uint64_t key = _glyph_key(font, size, codepoint);
+  struct cr_text_glyph_t* glyph = _glyph_find(text, key);
+  if(!glyph) {
+    if((text->n_glyphs + 1) * 2 > text->glyph_cap && !_glyph_grow(ctx, text)) return false;
+    uint32_t i = (uint32_t)(key ^ key >> 32) & (text->glyph_cap - 1);
+    while(text->glyphs[i].key) i = (i + 1) & (text->glyph_cap - 1);
+    glyph = &text->glyphs[i];
+    text->n_glyphs++;
+  }
+  *glyph = (struct cr_text_glyph_t){
+    .key = key,
+    .width = bitmap.pixels ? bitmap.width : 0,
+    .height = bitmap.pixels ? bitmap.height : 0,
+    .bearing_x = bitmap.bearing_x,
+    .bearing_y = bitmap.bearing_y,
+    .advance = bitmap.advance
+  };
+  *o_glyph = glyph;
+
+  // Blank glyphs (spaces) only advance the pen. A full atlas keeps the
+  // metrics; the glyph is then retried on its next draw.
+  if(glyph->width > 0 && glyph->height > 0) {
+    cr_atlas_insert(ctx, &text->atlas, key, bitmap.width, bitmap.height, bitmap.pixels, bitmap.stride, NULL);
+  }
+  return true;
+}
+
+struct cr_text_shape_t*
+_shape_find(struct cr_text_t* text, uint32_t font, float size, const char* str, uint64_t hash) {
+  for(uint32_t i = hash & (_SHAPE_TABLE_SIZE - 1); text->shapes[i].str; i = (i + 1) & (_SHAPE_TABLE_SIZE - 1)) {
+    struct cr_text_shape_t* shape = &text->shapes[i];
+    if(shape->hash == hash && shape->font == font && shape->size == size && strcmp(shape->str, str) == 0) {
+      return shape;
+    }
+  }
+  return NULL;
+}
+
+void
+_shape_evict(struct cr_context_t* ctx, struct cr_text_t* text) {
+  // Keeps the strings drawn this frame, reinserted so probing stays intact.
+  struct cr_text_shape_t* kept = cr_frame_scratch_alloc(ctx, text->n_shapes * sizeof *kept, sizeof(void*));
+  uint32_t n_kept = 0;
+  const uint64_t crnt_no = ctx->frameloop.frame_no + 1;
+  for(uint32_t i = 0; i < _SHAPE_TABLE_SIZE; i++) {
+    struct cr_text_shape_t* shape = &text->shapes[i];
+    if(!shape->str) continue;
+    if(kept && shape->last_use_no == crnt_no) {
+      kept[n_kept++] = *shape;
+    } else {
+      cr_host_free(ctx, shape->str);
+    }
+  }
+
+  memset(text->shapes, 0, _SHAPE_TABLE_SIZE * sizeof *text->shapes);
+  for(uint32_t k = 0; k < n_kept; k++) {
+    uint32_t i = kept[k].hash & (_SHAPE_TABLE_SIZE - 1);
+    while(text->shapes[i].str) i = (i + 1) & (_SHAPE_TABLE_SIZE - 1);
+    text->shapes[i] = kept[k];
+  }
+  text->n_shapes = n_kept;
+}
+
+struct cr_text_shape_t*
+_shape(struct cr_context_t* ctx, struct cr_text_t* text, uint32_t font, float size, const char* str) {
+  const size_t len = strlen(str);
+  const uint64_t hash = _hash_string(font, size, str, len);
+  struct cr_text_shape_t* shape = _shape_find(text, font, size, str, hash);
+  if(shape) {
+    text->n_shape_hits++;
+    shape->last_use_no = ctx->frameloop.frame_no + 1;
+    return shape;
+  }
+  text->n_shape_misses++;
+
+  if(text->n_shapes >= CR_TEXT_SHAPE_CACHE_SIZE) _shape_evict(ctx, text);
+
+  // One codepoint per byte at most.
+  const size_t glyphs_offset = (len + 1 + sizeof(float) - 1) & ~(sizeof(float) - 1);
+  struct cr_text_shape_t tmp = {
+    .hash = hash,
+    .font = font,
+    .size = size,
+    .last_use_no = ctx->frameloop.frame_no + 1
+  };
+  // Strings beyond what the cache may hold this frame are shaped into
+  // frame scratch memory instead.
+  const bool cached = text->n_shapes < CR_TEXT_SHAPE_CACHE_SIZE;
+  const size_t alloc_size = glyphs_offset + len * sizeof *tmp.glyphs;
+  tmp.str = cached ? cr_host_alloc(ctx, alloc_size) : cr_frame_scratch_alloc(ctx, alloc_size, sizeof(float));
+  if(!tmp.str) return NULL;
+  memcpy(tmp.str, str, len + 1);
+  tmp.glyphs = (struct _shaped_glyph_t*)(tmp.str + glyphs_offset);
+
+  // Codepoints map to glyphs one to one and are placed by their advances.
+  float pen = 0.0f;
+  for(const char* s = str; *s;) {
+    const uint32_t codepoint = _utf8_decode(&s);
+    struct cr_text_glyph_t* glyph = _glyph_find(text, _glyph_key(font, size, codepoint));
+    if(!glyph && !_rasterize(ctx, text, font, size, codepoint, &glyph)) continue;
+
+    tmp.glyphs[tmp.n_glyphs++] = (struct _shaped_glyph_t){ .codepoint = codepoint, .x = pen };
+    pen += glyph->advance;
+  }
+
+  if(!cached) {
+    shape = cr_frame_scratch_alloc(ctx, sizeof *shape, sizeof(void*));
+    if(shape) *shape = tmp;
+    return shape;
+  }
+  uint32_t i = hash & (_SHAPE_TABLE_SIZE - 1);
+  while(text->shapes[i].str) i = (i + 1) & (_SHAPE_TABLE_SIZE - 1);
+  text->shapes[i] = tmp;
+  text->n_shapes++;
+  return &text->shapes[i];
+}
+
+bool
+_push_instance(struct cr_context_t* ctx, struct cr_text_t* text, const struct cr_text_instance_t* inst) {
+  if(text->n_instances == text->instance_cap) {
+    const uint32_t cap = text->instance_cap ? text->instance_cap * 2 : 1024;
+    struct cr_text_instance_t* instances = cr_host_realloc(ctx, text->instances, cap * sizeof *instances);
+    if(!instances) return false;
+    text->instances = instances;
+    text->instance_cap = cap;
+  }
+  text->instances[text->n_instances++] = *inst;
+  return true;
+}
+
+bool
+cr_text_create(
+  struct cr_context_t* ctx,
+  struct cr_text_t* o_text,
+  cr_text_rasterize_func_t rasterize,
+  void* userdata) {
+  memset(o_text, 0, sizeof *o_text);
+  o_text->rasterize = rasterize;
+  o_text->userdata = userdata;
+
+  const struct cr_atlas_info_t atlas_info = {
+    .fmt = VK_FORMAT_R8_UNORM
+  };
+  if(!cr_atlas_init(ctx, &o_text->atlas, &atlas_info)) return false;
+
+  o_text->shapes = cr_host_calloc(ctx, _SHAPE_TABLE_SIZE, sizeof *o_text->shapes);
+  if(!o_text->shapes) {
+    CR_ERROR(ctx->log, "Failed to allocate shaping cache.");
+    return false;
+  }
+
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_LINEAR,
+    .minFilter = VK_FILTER_LINEAR,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateSampler(ctx->logical_dev, &sampler_info, ctx->host.vk_alloc, &o_text->sampler));
+
+  VkDescriptorSetLayoutBinding binding = {
+    .binding = 0,
+    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .descriptorCount = CR_ATLAS_MAX_PAGES,
+    .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+  };
+  VkDescriptorSetLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 1,
+    .pBindings = &binding
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateDescriptorSetLayout(ctx->logical_dev, &layout_info, ctx->host.vk_alloc, &o_text->set_layout));
+
+  VkDescriptorPoolSize pool_size = {
+    .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .descriptorCount = CR_ATLAS_MAX_PAGES * CR_FRAME_COUNT
+  };
+  VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets = CR_FRAME_COUNT,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size
+  };
+  _VK_CHECK(ctx, ctx->vk.CreateDescriptorPool(ctx->logical_dev, &pool_info, ctx->host.vk_alloc, &o_text->pool));
+
+  VkDescriptorSetLayout layouts[CR_FRAME_COUNT];
+  for(uint32_t i = 0; i < CR_FRAME_COUNT; i++) layouts[i] = o_text->set_layout;
+  VkDescriptorSetAllocateInfo set_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = o_text->pool,
+    .descriptorSetCount = CR_FRAME_COUNT,
+    .pSetLayouts = layouts
+  };
+  _VK_CHECK(ctx, ctx->vk.AllocateDescriptorSets(ctx->logical_dev, &set_info, o_text->sets));
+
+  CR_TRACE(ctx->log, "Initialized text renderer (shape cache: %i strings)", CR_TEXT_SHAPE_CACHE_SIZE);
+  return true;
+}
+
+void
+cr_text_destroy(struct cr_context_t* ctx, struct cr_text_t* text) {
+  cr_atlas_destroy(ctx, &text->atlas);
+
+  if(text->pool) {
+    cr_deletion_push(ctx, CR_DELETION_DESCRIPTOR_POOL, (union cr_deletion_handle_t){ .descriptor_pool = text->pool });
+  }
+  if(text->set_layout) {
+    cr_deletion_push(ctx, CR_DELETION_DESCRIPTOR_SET_LAYOUT,
+                     (union cr_deletion_handle_t){ .descriptor_set_layout = text->set_layout });
+  }
+  if(text->sampler) {
+    cr_deletion_push(ctx, CR_DELETION_SAMPLER, (union cr_deletion_handle_t){ .sampler = text->sampler });
+  }
+
+  if(text->shapes) {
+    for(uint32_t i = 0; i < _SHAPE_TABLE_SIZE; i++) {
+      cr_host_free(ctx, text->shapes[i].str);
+    }
+  }
+  cr_host_free(ctx, text->shapes);
+  cr_host_free(ctx, text->glyphs);
+  cr_host_free(ctx, text->instances);
+  memset(text, 0, sizeof *text);
+}
+
+void
+cr_text_bind(struct cr_text_t* text, VkPipeline pipeline, VkPipelineLayout layout) {
+  text->pipeline = pipeline;
+  text->layout = layout;
+}
+
+bool
+cr_text_draw(
+  struct cr_context_t* ctx,
+  struct cr_text_t* text,
+  uint32_t font,
+  float size,
+  const char* str,
+  float x,
+  float y,
+  const float color[4]) {
+  const struct cr_text_shape_t* shape = _shape(ctx, text, font, size, str);
+  if(!shape) return false;
+
+  for(uint32_t i = 0; i < shape->n_glyphs; i++) {
+    const uint32_t codepoint = shape->glyphs[i].codepoint;
+    const uint64_t key = _glyph_key(font, size, codepoint);
+    struct cr_text_glyph_t* glyph = _glyph_find(text, key);
+    if(!glyph || glyph->width == 0) continue;
+
+    // Only glyphs whose page was evicted since are rasterized again.
+    struct cr_atlas_entry_t entry;
+    if(!cr_atlas_lookup(ctx, &text->atlas, key, &entry) &&
+       (!_rasterize(ctx, text, font, size, codepoint, &glyph) || !cr_atlas_lookup(ctx, &text->atlas, key, &entry))) {
+      continue;
+    }
+
+    struct cr_text_instance_t inst = {
+      .x = x + shape->glyphs[i].x + (float)glyph->bearing_x,
+      .y = y + (float)glyph->bearing_y,
+      .w = (float)glyph->width,
+      .h = (float)glyph->height,
+      .uv = { entry.uv[0], entry.uv[1], entry.uv[2], entry.uv[3] },
+      .color = { color[0], color[1], color[2], color[3] },
+      .page = entry.page
+    };
+    if(!_push_instance(ctx, text, &inst)) return false;
+  }
+  return true;
+}
+
+bool
+cr_text_record(struct cr_context_t* ctx, struct cr_text_t* text, VkCommandBuffer cmd, VkRect2D rect) {
+  // The queue is uploaded by the first record of a frame; later outputs in
+  // the same frame draw the same instance range.
+  if(text->record_no != ctx->frameloop.frame_no + 1) {
+    text->record_no = ctx->frameloop.frame_no + 1;
+    text->record_buf = VK_NULL_HANDLE;
+    text->n_recorded = 0;
+
+    const uint32_t n_instances = text->n_instances;
+    text->n_instances = 0;
+    if(n_instances > 0) {
+      const VkDeviceSize size = (VkDeviceSize)n_instances * sizeof *text->instances;
+      void* dst = cr_frame_upload_alloc(ctx, size, sizeof(float) * 4, &text->record_buf, &text->record_offset);
+      if(!dst) {
+        CR_WARN(ctx->log, "Dropped %i glyphs, out of frame upload memory.", n_instances);
+        return true;
+      }
+      memcpy(dst, text->instances, size);
+      text->n_recorded = n_instances;
+    }
+  }
+  if(!text->pipeline || text->n_recorded == 0 || text->atlas.n_pages == 0) return true;
+
+  // The frame's set is idle once the frame has begun; unused array
+  // elements repeat the first page.
+  const uint32_t frame_idx = ctx->frameloop.frame_idx;
+  if(text->set_pages[frame_idx] != text->atlas.n_pages) {
+    VkDescriptorImageInfo infos[CR_ATLAS_MAX_PAGES];
+    for(uint32_t i = 0; i < CR_ATLAS_MAX_PAGES; i++) {
+      const uint32_t page = i < text->atlas.n_pages ? i : 0;
+      infos[i] = (VkDescriptorImageInfo){
+        .sampler = text->sampler,
+        .imageView = text->atlas.pages[page].view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+      };
+    }
+    VkWriteDescriptorSet write = {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = text->sets[frame_idx],
+      .dstBinding = 0,
+      .descriptorCount = CR_ATLAS_MAX_PAGES,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo = infos
+    };
+    ctx->vk.UpdateDescriptorSets(ctx->logical_dev, 1, &write, 0, NULL);
+    text->set_pages[frame_idx] = text->atlas.n_pages;
+  }
+
+  VkViewport viewport = {
+    .x = (float)rect.offset.x,
+    .y = (float)rect.offset.y,
+    .width = (float)rect.extent.width,
+    .height = (float)rect.extent.height,
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f
+  };
+  const float extent[2] = { (float)rect.extent.width, (float)rect.extent.height };
+
+  ctx->vk.CmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, text->pipeline);
+  ctx->vk.CmdSetViewport(cmd, 0, 1, &viewport);
+  ctx->vk.CmdSetScissor(cmd, 0, 1, &rect);
+  ctx->vk.CmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, text->layout, 0, 1, &text->sets[frame_idx], 0, NULL);
+  ctx->vk.CmdPushConstants(cmd, text->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof extent, extent);
+  ctx->vk.CmdBindVertexBuffers(cmd, 0, 1, &text->record_buf, &text->record_offset);
+  ctx->vk.CmdDraw(cmd, 4, text->n_recorded, 0, 0);
+
+  return true;
+}
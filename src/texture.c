@@ -0,0 +1,502 @@
+#include "../include/corender/texture.h"
+#include "../include/corender/corender.h"
+#include "../include/corender/util.h"
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define _SUBSYS_NAME "TEXTURE"
+
+// Size of one row of blocks (or of pixels, for RGBA8) and the number of
+// such rows in a level.
+struct _level_layout_t {
+  uint32_t width, height;
+  size_t row_size;
+  uint32_t n_rows;
+};
+
+static VkFormat _vk_format(enum cr_texture_format_t fmt, bool srgb);
+static uint32_t _block_dim(enum cr_texture_format_t fmt);
+static size_t   _block_size(enum cr_texture_format_t fmt);
+static struct _level_layout_t _level_layout(enum cr_texture_format_t fmt, VkExtent2D extent, uint32_t level);
+static size_t   _data_size(enum cr_texture_format_t fmt, VkExtent2D extent, uint32_t n_levels);
+static void     _decode_color_block(const uint8_t* block, bool opaque, uint8_t o_texels[16][4]);
+static void     _decode_alpha_block(const uint8_t* block, uint8_t o_texels[16][4]);
+static void     _decode_level(enum cr_texture_format_t fmt, const uint8_t* src, uint32_t w, uint32_t h, uint8_t* dst);
+static bool     _can_blit(struct cr_context_t* ctx, VkFormat fmt);
+static bool     _record_chunks(struct cr_context_t* ctx, struct cr_texture_t* tex, VkCommandBuffer cmd, VkDeviceSize* budget);
+static void     _record_finish(struct cr_context_t* ctx, struct cr_texture_t* tex, VkCommandBuffer cmd);
+static void     _unlink(struct cr_context_t* ctx, struct cr_texture_t* tex);
+
+VkFormat
+_vk_format(enum cr_texture_format_t fmt, bool srgb) {
+  switch(fmt) {
+    case CR_TEXTURE_FORMAT_BC1: return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case CR_TEXTURE_FORMAT_BC3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case CR_TEXTURE_FORMAT_BC7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default:                    return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  }
+}
+
+uint32_t
+_block_dim(enum cr_texture_format_t fmt) {
+  return fmt == CR_TEXTURE_FORMAT_RGBA8 ? 1 : 4;
+}
+
+size_t
+_block_size(enum cr_texture_format_t fmt) {
+  switch(fmt) {
+    case CR_TEXTURE_FORMAT_BC1: return 8;
+    case CR_TEXTURE_FORMAT_BC3:
+    case CR_TEXTURE_FORMAT_BC7: return 16;
+    default:                    return 4;
+  }
+}
+
+struct _level_layout_t
+_level_layout(enum cr_texture_format_t fmt, VkExtent2D extent, uint32_t level) {
+  struct _level_layout_t layout;
+  layout.width = extent.width >> level ? extent.width >> level : 1;
+  layout.height = extent.height >> level ? extent.height >> level : 1;
+
+  const uint32_t dim = _block_dim(fmt);
+  layout.row_size = (size_t)((layout.width + dim - 1) / dim) * _block_size(fmt);
+  layout.n_rows = (layout.height + dim - 1) / dim;
+  return layout;
+}
+
+size_t
+_data_size(enum cr_texture_format_t fmt, VkExtent2D extent, uint32_t n_levels) {
+  size_t size = 0;
+  for(uint32_t i = 0; i < n_levels; i++) {
+    struct _level_layout_t layout = _level_layout(fmt, extent, i);
+    size += layout.row_size * layout.n_rows;
+  }
+  return size;
+}
+
+void
+_decode_color_block(const uint8_t* block, bool opaque, uint8_t o_texels[16][4]) {
+  const uint16_t c[2] = {
+    (uint16_t)(block[0] | block[1] << 8),
+    (uint16_t)(block[2] | block[3] << 8)
+  };
+  uint8_t palette[4][4];
+  for(uint32_t i = 0; i < 2; i++) {
+    const uint32_t r = (c[i] >> 11) & 0x1f, g = (c[i] >> 5) & 0x3f, b = c[i] & 0x1f;
+    palette[i][0] = (uint8_t)(r << 3 | r >> 2);
+    palette[i][1] = (uint8_t)(g << 2 | g >> 4);
+    palette[i][2] = (uint8_t)(b << 3 | b >> 2);
+    palette[i][3] = 255;
+  }
+  // BC1 switches to three colors plus transparent black when the
+  // endpoints are not ordered; BC3 color blocks always use four.
+  const bool four = opaque || c[0] > c[1];
+  for(uint32_t ch = 0; ch < 3; ch++) {
+    if(four) {
+      palette[2][ch] = (uint8_t)((2 * palette[0][ch] + palette[1][ch]) / 3);
+      palette[3][ch] = (uint8_t)((palette[0][ch] + 2 * palette[1][ch]) / 3);
+    } else {
+      palette[2][ch] = (uint8_t)((palette[0][ch] + palette[1][ch]) / 2);
+      palette[3][ch] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = four ? 255 : 0;
+
+  const uint32_t indices = (uint32_t)block[4] | (uint32_t)block[5] << 8 |
+    (uint32_t)block[6] << 16 | (uint32_t)block[7] << 24;
+  for(uint32_t i = 0; i < 16; i++) {
+    memcpy(o_texels[i], palette[(indices >> (2 * i)) & 3], 4);
+  }
+}
+
+void
+_decode_alpha_block(const uint8_t* block, uint8_t o_texels[16][4]) {
+  uint8_t alpha[8] = { block[0], block[1] };
+  if(alpha[0] > alpha[1]) {
+    for(uint32_t i = 1; i < 7; i++) {
+      alpha[i + 1] = (uint8_t)(((7 - i) * alpha[0] + i * alpha[1]) / 7);
+    }
+  } else {
+    for(uint32_t i = 1; i < 5; i++) {
+      alpha[i + 1] = (uint8_t)(((5 - i) * alpha[0] + i * alpha[1]) / 5);
+    }
+    alpha[6] = 0;
+    alpha[7] = 255;
+  }
+
+  uint64_t indices = 0;
+  for(uint32_t i = 0; i < 6; i++) {
+    indices |= (uint64_t)block[2 + i] << (8 * i);
+  }
+  for(uint32_t i = 0; i < 16; i++) {
+    o_texels[i][3] = alpha[(indices >> (3 * i)) & 7];
+  }
+}
+
+void
+_decode_level(enum cr_texture_format_t fmt, const uint8_t* src, uint32_t w, uint32_t h, uint8_t* dst) {
+  const size_t block_size = _block_size(fmt);
+  for(uint32_t by = 0; by < h; by += 4) {
+    for(uint32_t bx = 0; bx < w; bx += 4) {
+      uint8_t texels[16][4];
+      if(fmt == CR_TEXTURE_FORMAT_BC3) {
+        _decode_color_block(src + 8, true, texels);
+        _decode_alpha_block(src, texels);
+      } else {
+        _decode_color_block(src, false, texels);
+      }
+      src += block_size;
+
+      // Blocks on the right and bottom edges may hang over the level.
+      for(uint32_t y = 0; y < 4 && by + y < h; y++) {
+        for(uint32_t x = 0; x < 4 && bx + x < w; x++) {
+          memcpy(dst + ((size_t)(by + y) * w + bx + x) * 4, texels[y * 4 + x], 4);
+        }
+      }
+    }
+  }
+}
+
+bool
+_can_blit(struct cr_context_t* ctx, VkFormat fmt) {
+  VkFormatProperties props;
+  ctx->vk.GetPhysicalDeviceFormatProperties(ctx->phys_dev, fmt, &props);
+  const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (props.optimalTilingFeatures & needed) == needed;
+}
+
+bool
+cr_texture_format_supported(struct cr_context_t* ctx, enum cr_texture_format_t fmt, bool srgb) {
+  if(fmt != CR_TEXTURE_FORMAT_RGBA8 && !ctx->features.texture_compression_bc) return false;
+
+  VkFormatProperties props;
+  ctx->vk.GetPhysicalDeviceFormatProperties(ctx->phys_dev, _vk_format(fmt, srgb), &props);
+  const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+  return (props.optimalTilingFeatures & needed) == needed;
+}
+
+bool
+cr_texture_create(
+  struct cr_context_t* ctx,
+  struct cr_texture_t* o_tex,
+  const struct cr_texture_info_t* info) {
+  memset(o_tex, 0, sizeof *o_tex);
+
+  const VkExtent2D extent = { info->width, info->height };
+  const uint32_t n_data_levels = info->n_levels ? info->n_levels : 1;
+  const size_t data_size = _data_size(info->fmt, extent, n_data_levels);
+  if(!info->data || extent.width == 0 || extent.height == 0 || info->size < data_size) {
+    CR_ERROR(ctx->log, "Invalid texture data (width: %i, height: %i, levels: %i, size: %lu, expected: %lu)",
+             extent.width, extent.height, n_data_levels, (unsigned long)info->size, (unsigned long)data_size);
+    return false;
+  }
+
+  enum cr_texture_format_t fmt = info->fmt;
+  if(!cr_texture_format_supported(ctx, fmt, info->srgb)) {
+    if(fmt == CR_TEXTURE_FORMAT_BC7 || fmt == CR_TEXTURE_FORMAT_RGBA8) {
+      CR_ERROR(ctx->log, "Texture format %i is not supported by the device.", fmt);
+      return false;
+    }
+    fmt = CR_TEXTURE_FORMAT_RGBA8;
+    o_tex->decoded = true;
+  }
+
+  uint32_t n_levels = n_data_levels;
+  o_tex->fmt = _vk_format(fmt, info->srgb);
+  if(info->gen_mips && fmt == CR_TEXTURE_FORMAT_RGBA8) {
+    if(_can_blit(ctx, o_tex->fmt)) {
+      uint32_t largest = extent.width > extent.height ? extent.width : extent.height;
+      for(n_levels = 1; largest > 1; largest >>= 1) n_levels++;
+      if(n_levels < n_data_levels) n_levels = n_data_levels;
+    } else {
+      CR_TRACE(ctx->log, "Format %i cannot be blitted, keeping %i level(s).", o_tex->fmt, n_data_levels);
+    }
+  }
+  o_tex->data_fmt = fmt;
+  o_tex->extent = extent;
+  o_tex->n_levels = n_levels;
+  o_tex->n_data_levels = n_data_levels;
+
+  // The caller's data may go away before the upload finishes.
+  const size_t staging_size = _data_size(fmt, extent, n_data_levels);
+  o_tex->staging = cr_host_alloc(ctx, staging_size);
+  if(!o_tex->staging) {
+    CR_ERROR(ctx->log, "Failed to allocate texture staging memory (size: %lu)", (unsigned long)staging_size);
+    return false;
+  }
+  if(o_tex->decoded) {
+    const uint8_t* src = info->data;
+    uint8_t* dst = o_tex->staging;
+    for(uint32_t i = 0; i < n_data_levels; i++) {
+      const struct _level_layout_t compressed = _level_layout(info->fmt, extent, i);
+      const struct _level_layout_t decoded = _level_layout(fmt, extent, i);
+      _decode_level(info->fmt, src, decoded.width, decoded.height, dst);
+      src += compressed.row_size * compressed.n_rows;
+      dst += decoded.row_size * decoded.n_rows;
+    }
+  } else {
+    memcpy(o_tex->staging, info->data, staging_size);
+  }
+
+  VkImageCreateInfo img_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = o_tex->fmt,
+    .extent = { extent.width, extent.height, 1 },
+    .mipLevels = n_levels,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+      (n_levels > n_data_levels ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+  };
+  VkResult res = ctx->vk.CreateImage(ctx->logical_dev, &img_info, ctx->host.vk_alloc, &o_tex->image);
+  if(res != VK_SUCCESS) {
+    cr_texture_destroy(ctx, o_tex);
+    _VK_CHECK(ctx, res);
+  }
+
+  VkMemoryRequirements reqs;
+  ctx->vk.GetImageMemoryRequirements(ctx->logical_dev, o_tex->image, &reqs);
+  if(!cr_memory_alloc(ctx, &reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &o_tex->mem, &o_tex->mem_type)) {
+    CR_ERROR(ctx->log, "Failed to allocate texture memory (size: %lu)", (unsigned long)reqs.size);
+    cr_texture_destroy(ctx, o_tex);
+    return false;
+  }
+  o_tex->mem_size = reqs.size;
+  res = ctx->vk.BindImageMemory(ctx->logical_dev, o_tex->image, o_tex->mem, 0);
+
+  VkImageViewCreateInfo view_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image = o_tex->image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = o_tex->fmt,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = n_levels,
+      .layerCount = 1
+    }
+  };
+  if(res == VK_SUCCESS) {
+    res = ctx->vk.CreateImageView(ctx->logical_dev, &view_info, ctx->host.vk_alloc, &o_tex->view);
+  }
+  if(res != VK_SUCCESS) {
+    cr_texture_destroy(ctx, o_tex);
+    _VK_CHECK(ctx, res);
+  }
+
+  struct cr_texture_uploads_t* uploads = &ctx->textures;
+  if(uploads->tail) {
+    uploads->tail->next = o_tex;
+  } else {
+    uploads->head = o_tex;
+  }
+  uploads->tail = o_tex;
+
+  CR_TRACE(ctx->log, "Created texture (width: %i, height: %i, format: %i, levels: %i, generated: %i, decoded: %s)",
+           extent.width, extent.height, o_tex->fmt, n_levels, n_levels - n_data_levels,
+           o_tex->decoded ? "true" : "false");
+
+  return true;
+}
+
+bool
+_record_chunks(struct cr_context_t* ctx, struct cr_texture_t* tex, VkCommandBuffer cmd, VkDeviceSize* budget) {
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = tex->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = tex->n_levels,
+      .layerCount = 1
+    }
+  };
+  if(!tex->upload_started) {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ctx->vk.CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                               0, 0, NULL, 0, NULL, 1, &barrier);
+    tex->upload_started = true;
+  }
+
+  // Chunks of one level go to disjoint rows and need no barriers between
+  // them, within a frame or across frames.
+  const enum cr_texture_format_t fmt = tex->data_fmt;
+  const uint32_t dim = _block_dim(fmt);
+
+  while(tex->upload_level < tex->n_data_levels) {
+    const struct _level_layout_t layout = _level_layout(fmt, tex->extent, tex->upload_level);
+    uint32_t n_rows = layout.n_rows - tex->upload_row;
+    if((VkDeviceSize)n_rows * layout.row_size > *budget) {
+      n_rows = (uint32_t)(*budget / layout.row_size);
+    }
+    if(n_rows == 0) return true;
+
+    const VkDeviceSize size = (VkDeviceSize)n_rows * layout.row_size;
+    VkBuffer src;
+    VkDeviceSize offset;
+    uint8_t* dst = cr_frame_upload_alloc(ctx, size, 16, &src, &offset);
+    if(!dst) {
+      // Upload memory is taken by others this frame; continue next frame.
+      *budget = 0;
+      return true;
+    }
+    memcpy(dst, tex->staging + tex->staging_offset, size);
+
+    const uint32_t y = tex->upload_row * dim;
+    const uint32_t h = (tex->upload_row + n_rows) * dim < layout.height ? n_rows * dim : layout.height - y;
+    VkBufferImageCopy region = {
+      .bufferOffset = offset,
+      .imageSubresource = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .mipLevel = tex->upload_level,
+        .layerCount = 1
+      },
+      .imageOffset = { 0, (int32_t)y, 0 },
+      .imageExtent = { layout.width, h, 1 }
+    };
+    ctx->vk.CmdCopyBufferToImage(cmd, src, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    ctx->textures.n_bytes += size;
+    *budget -= size;
+    tex->staging_offset += size;
+    tex->upload_row += n_rows;
+    if(tex->upload_row == layout.n_rows) {
+      tex->upload_row = 0;
+      tex->upload_level++;
+    }
+  }
+  return true;
+}
+
+void
+_record_finish(struct cr_context_t* ctx, struct cr_texture_t* tex, VkCommandBuffer cmd) {
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = tex->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = 1,
+      .layerCount = 1
+    }
+  };
+
+  // Each generated level is blitted from the one above, which is moved to
+  // TRANSFER_SRC first; all of it lands in the frame's command buffer.
+  for(uint32_t level = tex->n_data_levels; level < tex->n_levels; level++) {
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    ctx->vk.CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                               0, 0, NULL, 0, NULL, 1, &barrier);
+
+    const int32_t src_w = (int32_t)(tex->extent.width >> (level - 1) ? tex->extent.width >> (level - 1) : 1);
+    const int32_t src_h = (int32_t)(tex->extent.height >> (level - 1) ? tex->extent.height >> (level - 1) : 1);
+    VkImageBlit blit = {
+      .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 },
+      .srcOffsets = { { 0, 0, 0 }, { src_w, src_h, 1 } },
+      .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+      .dstOffsets = { { 0, 0, 0 }, { src_w > 1 ? src_w / 2 : 1, src_h > 1 ? src_h / 2 : 1, 1 } }
+    };
+    ctx->vk.CmdBlitImage(cmd, tex->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+  }
+
+  // Blit sources are in TRANSFER_SRC, every other level in TRANSFER_DST.
+  VkImageMemoryBarrier barriers[3];
+  uint32_t n_barriers = 0;
+  const uint32_t first_src = tex->n_data_levels - 1;
+  const uint32_t n_src = tex->n_levels - tex->n_data_levels;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  if(n_src == 0) {
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = tex->n_levels;
+    barriers[n_barriers++] = barrier;
+  } else {
+    if(first_src > 0) {
+      barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.subresourceRange.baseMipLevel = 0;
+      barrier.subresourceRange.levelCount = first_src;
+      barriers[n_barriers++] = barrier;
+    }
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.subresourceRange.baseMipLevel = first_src;
+    barrier.subresourceRange.levelCount = n_src;
+    barriers[n_barriers++] = barrier;
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.subresourceRange.baseMipLevel = tex->n_levels - 1;
+    barrier.subresourceRange.levelCount = 1;
+    barriers[n_barriers++] = barrier;
+  }
+  ctx->vk.CmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, NULL, 0, NULL, n_barriers, barriers);
+}
+
+void
+_unlink(struct cr_context_t* ctx, struct cr_texture_t* tex) {
+  struct cr_texture_uploads_t* uploads = &ctx->textures;
+  struct cr_texture_t* prev = NULL;
+  for(struct cr_texture_t* it = uploads->head; it; prev = it, it = it->next) {
+    if(it != tex) continue;
+    if(prev) {
+      prev->next = tex->next;
+    } else {
+      uploads->head = tex->next;
+    }
+    if(uploads->tail == tex) uploads->tail = prev;
+    break;
+  }
+  tex->next = NULL;
+}
+
+bool
+cr_texture_record_uploads(struct cr_context_t* ctx, VkCommandBuffer cmd) {
+  VkDeviceSize budget = CR_TEXTURE_UPLOAD_BUDGET;
+  while(ctx->textures.head && budget > 0) {
+    struct cr_texture_t* tex = ctx->textures.head;
+    if(!_record_chunks(ctx, tex, cmd, &budget)) return false;
+    if(tex->upload_level < tex->n_data_levels) break;
+
+    _record_finish(ctx, tex, cmd);
+    _unlink(ctx, tex);
+    cr_host_free(ctx, tex->staging);
+    tex->staging = NULL;
+    tex->ready = true;
+  }
+  return true;
+}
+
+void
+cr_texture_destroy(struct cr_context_t* ctx, struct cr_texture_t* tex) {
+  _unlink(ctx, tex);
+  cr_host_free(ctx, tex->staging);
+
+  if(tex->view) {
+    cr_deletion_push(ctx, CR_DELETION_IMAGE_VIEW, (union cr_deletion_handle_t){ .image_view = tex->view });
+  }
+  if(tex->image) {
+    cr_deletion_push(ctx, CR_DELETION_IMAGE, (union cr_deletion_handle_t){ .image = tex->image });
+  }
+  if(tex->mem) {
+    union cr_deletion_handle_t h = { .memory = { tex->mem, tex->mem_size, tex->mem_type } };
+    cr_deletion_push(ctx, CR_DELETION_MEMORY, h);
+  }
+  memset(tex, 0, sizeof *tex);
+}